@@ -0,0 +1,136 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Fixed-capacity ring buffer that replays a signal after a delay. The signal is stored run-length encoded:
+ * consecutive samples with similar values are merged into one segment covering the time they span.
+ * Reading the value from now - delay gives the same delay at any frame rate, and memory never grows past the capacity.
+ * Pointers returned by sample are only valid until the next push.
+ */
+template<typename SampleType>
+class TDelayLine
+{
+public:
+	//Storage is allocated by the first push, so objects that never use the line, like class defaults, do not pay for it
+	explicit TDelayLine(int32 in_capacity)
+		: capacity(FMath::Max(in_capacity, 1))
+	{
+	}
+
+	/**
+	* Adds a sample covering [time, time + duration). If it follows straight on from the newest segment and
+	* can_merge returns true for the two values, the newest segment is extended instead of adding a new one.
+	* When the line is full the two oldest segments after the one being sampled are merged, so the value being
+	* replayed now is never lost.
+	* @param time - when the sample arrived, in seconds
+	* @param duration - how long the sample is expected to last, usually the frame time
+	* @param can_merge - called with the newest segment's value and the new value
+	**/
+	template<typename MergeFunctionType>
+	void push(float time, float duration, const SampleType& value, MergeFunctionType can_merge)
+	{
+		if (segments.Num() == 0)
+		{
+			segments.SetNum(capacity);
+		}
+
+		if (count > 0)
+		{
+			segment& newest = segments[(head + count - 1) % capacity];
+
+			//Frame times are only estimates, so close the small gap or overlap left by the previous sample
+			if (FMath::Abs(time - newest.end) <= max_gap)
+			{
+				newest.end = time;
+				if (can_merge(newest.value, value))
+				{
+					newest.end = time + duration;
+					return;
+				}
+			}
+		}
+
+		if (count == capacity)
+		{
+			if (count >= 3)
+			{
+				//The oldest unread segment is folded into the one after it, which then starts earlier. The sampled
+				//segment moves into the freed slot so the ring stays contiguous.
+				const int32 oldest_unread = (head + 1) % capacity;
+				segments[(head + 2) % capacity].start = segments[oldest_unread].start;
+				segments[oldest_unread] = MoveTemp(segments[head]);
+				head = oldest_unread;
+			}
+			else
+			{
+				head = (head + 1) % capacity;
+			}
+			count--;
+		}
+
+		segment& tail = segments[(head + count) % capacity];
+		tail.start = time;
+		tail.end = time + duration;
+		tail.value = value;
+		count++;
+	}
+
+	/**
+	* Drops every segment that ended before now - delay.
+	* @param out_pushed_at - if given, set to when the returned run of values was first pushed
+	* @return The value that was pushed at now - delay, or nullptr if nothing was pushed then
+	**/
+	const SampleType* sample(float now, float delay, float* out_pushed_at = nullptr)
+	{
+		const float delayed_time = now - delay;
+		while (count > 0 && segments[head].end <= delayed_time)
+		{
+			head = (head + 1) % capacity;
+			count--;
+		}
+
+		if (count > 0 && segments[head].start <= delayed_time)
+		{
+			if (out_pushed_at != nullptr)
+			{
+				*out_pushed_at = segments[head].start;
+			}
+			return &segments[head].value;
+		}
+		return nullptr;
+	}
+
+	inline void reset()
+	{
+		head = 0;
+		count = 0;
+	}
+
+	//Number of segments being held
+	inline int32 num() const { return count; }
+
+	inline bool isEmpty() const { return count == 0; }
+
+private:
+	struct segment
+	{
+		float start = 0.0f;
+		float end = 0.0f;
+		SampleType value;
+	};
+
+	//Largest gap in seconds between two samples that still counts as one continuous signal
+	static constexpr float max_gap = 0.1f;
+
+	TArray<segment> segments;
+
+	int32 capacity;
+
+	//Index of the oldest segment
+	int32 head = 0;
+
+	int32 count = 0;
+};
@@ -0,0 +1,354 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MergeMeshesCommandlet.h"
+#include "StayCalm.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Level.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "UObject/Package.h"
+
+namespace MeshMerge
+{
+	//Actors with this tag are never merged, e.g. props a level script refers to
+	const FName no_merge_tag(TEXT("NoMerge"));
+
+	int32 sectionCount(const UStaticMesh* mesh)
+	{
+		return mesh != nullptr && mesh->GetNumLODs() > 0 ? mesh->GetNumSections(0) : 0;
+	}
+}
+
+UStayCalmMergeMeshesCommandlet::UStayCalmMergeMeshesCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+bool UStayCalmMergeMeshesCommandlet::group_key::operator==(const group_key& other) const
+{
+	return mesh == other.mesh
+		&& materials == other.materials
+		&& collision_enabled == other.collision_enabled
+		&& object_type == other.object_type
+		&& FMemory::Memcmp(responses.EnumArray, other.responses.EnumArray, sizeof(responses.EnumArray)) == 0
+		&& collision_profile == other.collision_profile
+		&& generate_overlap_events == other.generate_overlap_events
+		&& cast_shadow == other.cast_shadow
+		&& max_draw_distance == other.max_draw_distance;
+}
+
+uint32 UStayCalmMergeMeshesCommandlet::group_key::hash() const
+{
+	uint32 result = GetTypeHash(mesh);
+	for (const UMaterialInterface* material : materials)
+	{
+		result = HashCombine(result, GetTypeHash(material));
+	}
+	result = HashCombine(result, FCrc::MemCrc32(responses.EnumArray, sizeof(responses.EnumArray)));
+	result = HashCombine(result, GetTypeHash(collision_profile));
+	return HashCombine(result, (uint32)collision_enabled | ((uint32)object_type << 8) | ((uint32)generate_overlap_events << 16) | ((uint32)cast_shadow << 17));
+}
+
+int32 UStayCalmMergeMeshesCommandlet::Main(const FString& Params)
+{
+#if WITH_EDITOR
+	FString map_list;
+	if (!FParse::Value(*Params, TEXT("Maps="), map_list, false))
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("Give the maps to merge with -Maps=<names>"));
+		return 1;
+	}
+
+	int32 min_instances = 4;
+	FParse::Value(*Params, TEXT("MinInstances="), min_instances);
+	min_instances = FMath::Max(min_instances, 2);
+
+	const bool dry_run = FParse::Param(*Params, TEXT("DryRun"));
+
+	FString output_path;
+	FParse::Value(*Params, TEXT("Output="), output_path);
+
+	TArray<FString> maps;
+	map_list.ParseIntoArray(maps, TEXT(","));
+
+	int32 failures = 0;
+	for (const FString& map : maps)
+	{
+		const FString map_output = !output_path.IsEmpty() && maps.Num() == 1 ? output_path
+			: FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("MeshMerge"), FPackageName::GetShortName(map));
+		if (!mergeMap(map.TrimStartAndEnd(), min_instances, dry_run, map_output))
+		{
+			failures++;
+		}
+	}
+	return failures > 0 ? 1 : 0;
+#else
+	UE_LOG(LogStayCalm, Error, TEXT("Merging meshes needs an editor build"));
+	return 1;
+#endif
+}
+
+#if WITH_EDITOR
+
+bool UStayCalmMergeMeshesCommandlet::mergeMap(const FString& map_name, int32 min_instances, bool dry_run, const FString& output_path)
+{
+	//Short names like Level1_Home are looked up on disk
+	FString package_name = map_name;
+	if (!FPackageName::IsValidLongPackageName(package_name) && !FPackageName::SearchForPackageOnDisk(map_name, &package_name))
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("Could not find map %s"), *map_name);
+		return false;
+	}
+
+	UPackage* package = LoadPackage(nullptr, *package_name, LOAD_None);
+	UWorld* world = package != nullptr ? UWorld::FindWorldInPackage(package) : nullptr;
+	if (world == nullptr)
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("%s is not a map"), *package_name);
+		return false;
+	}
+
+	//Components are registered so instance bounds and collision bodies are built as in the editor
+	world->WorldType = EWorldType::Editor;
+	world->AddToRoot();
+	if (!world->bIsWorldInitialized)
+	{
+		world->InitWorld(UWorld::InitializationValues()
+			.AllowAudioPlayback(false)
+			.CreateAISystem(false)
+			.CreateNavigation(false)
+			.RequiresHitProxies(false)
+			.ShouldSimulatePhysics(false)
+			.EnableTraceCollision(false));
+	}
+	world->UpdateWorldComponents(true, false);
+
+	ULevel* level = world->PersistentLevel;
+	const level_counts before = countLevel(level);
+
+	//Group candidates in level order so the result is the same every run
+	TMap<group_key, TArray<AStaticMeshActor*>> groups;
+	for (AActor* actor : level->Actors)
+	{
+		AStaticMeshActor* mesh_actor = Cast<AStaticMeshActor>(actor);
+		if (const UStaticMeshComponent* component = mergeableComponent(mesh_actor))
+		{
+			groups.FindOrAdd(keyFor(component)).Add(mesh_actor);
+		}
+	}
+
+	TArray<group_report> reports;
+	int32 merged_actors = 0;
+	for (TPair<group_key, TArray<AStaticMeshActor*>>& group : groups)
+	{
+		const group_key& key = group.Key;
+		TArray<AStaticMeshActor*>& actors = group.Value;
+		if (actors.Num() < min_instances)
+		{
+			continue;
+		}
+
+		group_report& report = reports.AddDefaulted_GetRef();
+		report.mesh = key.mesh->GetPathName();
+		report.instances = actors.Num();
+		report.draw_calls_before = MeshMerge::sectionCount(key.mesh) * actors.Num();
+		report.draw_calls_after = MeshMerge::sectionCount(key.mesh);
+		merged_actors += actors.Num();
+
+		if (dry_run)
+		{
+			continue;
+		}
+
+		const UStaticMeshComponent* source = actors[0]->GetStaticMeshComponent();
+
+		FActorSpawnParameters spawn_parameters;
+		spawn_parameters.OverrideLevel = level;
+		spawn_parameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		spawn_parameters.Name = MakeUniqueObjectName(level, AActor::StaticClass(), *FString::Printf(TEXT("Merged_%s"), *key.mesh->GetName()));
+		AActor* merged = world->SpawnActor<AActor>(AActor::StaticClass(), FTransform(actors[0]->GetActorLocation()), spawn_parameters);
+		merged->SetActorLabel(spawn_parameters.Name.ToString());
+		merged->Tags.Add(MeshMerge::no_merge_tag);
+
+		UHierarchicalInstancedStaticMeshComponent* instances = NewObject<UHierarchicalInstancedStaticMeshComponent>(merged, TEXT("Instances"), RF_Transactional);
+		instances->SetMobility(EComponentMobility::Static);
+		instances->SetStaticMesh(key.mesh);
+		for (int32 slot = 0; slot < key.materials.Num(); slot++)
+		{
+			instances->SetMaterial(slot, key.materials[slot]);
+		}
+
+		//Same profile, object type and per-channel responses, so sensing traces hit instances as they hit the actors
+		instances->BodyInstance.CopyBodyInstancePropertiesFrom(&source->BodyInstance);
+		instances->SetGenerateOverlapEvents(key.generate_overlap_events);
+		instances->CastShadow = key.cast_shadow;
+		instances->LDMaxDrawDistance = key.max_draw_distance;
+		instances->bCastDynamicShadow = source->bCastDynamicShadow;
+		instances->bCastStaticShadow = source->bCastStaticShadow;
+		instances->SetCanEverAffectNavigation(source->CanEverAffectNavigation());
+
+		merged->SetRootComponent(instances);
+		merged->AddInstanceComponent(instances);
+		instances->SetWorldTransform(FTransform(actors[0]->GetActorLocation()));
+		instances->RegisterComponent();
+
+		for (AStaticMeshActor* actor : actors)
+		{
+			instances->AddInstanceWorldSpace(actor->GetStaticMeshComponent()->GetComponentTransform());
+			world->EditorDestroyActor(actor, true);
+		}
+		instances->BuildTreeIfOutdated(false, true);
+	}
+
+	level_counts after = countLevel(level);
+	if (dry_run)
+	{
+		//Nothing changed, so work out what merging would give
+		after.actors = before.actors - merged_actors + reports.Num();
+		after.draw_calls = before.draw_calls;
+		for (const group_report& report : reports)
+		{
+			after.draw_calls -= report.draw_calls_before - report.draw_calls_after;
+		}
+		after.memory_bytes = before.memory_bytes;
+	}
+
+	UE_LOG(LogStayCalm, Display, TEXT("%s: %d groups from %d actors. Actors %d -> %d, mesh draw calls %d -> %d, memory %.1f KB -> %.1f KB%s"),
+		*package_name, reports.Num(), merged_actors, before.actors, after.actors, before.draw_calls, after.draw_calls,
+		before.memory_bytes / 1024.0, after.memory_bytes / 1024.0, dry_run ? TEXT(" (dry run, memory not estimated)") : TEXT(""));
+
+	bool saved = true;
+	if (!dry_run && reports.Num() > 0)
+	{
+		const FString filename = FPackageName::LongPackageNameToFilename(package_name, FPackageName::GetMapPackageExtension());
+		saved = UPackage::SavePackage(package, world, RF_Standalone, *filename, GError, nullptr, false, true, SAVE_NoError);
+		if (!saved)
+		{
+			UE_LOG(LogStayCalm, Error, TEXT("Could not save %s"), *filename);
+		}
+		else
+		{
+			//The merged actors' baked lightmaps were thrown away with them and the instances have none yet
+			UE_LOG(LogStayCalm, Warning, TEXT("%s: %d merged meshes have no baked lighting. Rebuild lighting for this map before shipping it."),
+				*package_name, reports.Num());
+		}
+	}
+
+	const bool reported = writeReport(package_name, before, after, reports, output_path);
+
+	world->DestroyWorld(false);
+	world->RemoveFromRoot();
+	CollectGarbage(RF_NoFlags);
+
+	return saved && reported;
+}
+
+UStaticMeshComponent* UStayCalmMergeMeshesCommandlet::mergeableComponent(AStaticMeshActor* actor)
+{
+	//Subclasses may carry blueprint logic that needs the actor
+	if (actor == nullptr || actor->GetClass() != AStaticMeshActor::StaticClass() || actor->IsPendingKill() || actor->ActorHasTag(MeshMerge::no_merge_tag))
+	{
+		return nullptr;
+	}
+
+	TArray<AActor*> attached;
+	actor->GetAttachedActors(attached);
+	if (actor->GetAttachParentActor() != nullptr || attached.Num() > 0)
+	{
+		return nullptr;
+	}
+
+	UStaticMeshComponent* component = actor->GetStaticMeshComponent();
+	if (component == nullptr || component->GetStaticMesh() == nullptr || component->Mobility != EComponentMobility::Static)
+	{
+		return nullptr;
+	}
+	return component;
+}
+
+UStayCalmMergeMeshesCommandlet::group_key UStayCalmMergeMeshesCommandlet::keyFor(const UStaticMeshComponent* component)
+{
+	group_key key;
+	key.mesh = component->GetStaticMesh();
+	for (int32 slot = 0; slot < component->GetNumMaterials(); slot++)
+	{
+		key.materials.Add(component->GetMaterial(slot));
+	}
+	key.collision_enabled = component->GetCollisionEnabled();
+	key.object_type = component->GetCollisionObjectType();
+	key.responses = component->GetCollisionResponseToChannels();
+	key.collision_profile = component->GetCollisionProfileName();
+	key.generate_overlap_events = component->GetGenerateOverlapEvents();
+	key.cast_shadow = component->CastShadow;
+	key.max_draw_distance = component->LDMaxDrawDistance;
+	return key;
+}
+
+UStayCalmMergeMeshesCommandlet::level_counts UStayCalmMergeMeshesCommandlet::countLevel(const ULevel* level)
+{
+	level_counts counts;
+	for (AActor* actor : level->Actors)
+	{
+		if (actor == nullptr || actor->IsPendingKill())
+		{
+			continue;
+		}
+
+		counts.actors++;
+		counts.memory_bytes += actor->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+
+		for (UActorComponent* component : actor->GetComponents())
+		{
+			counts.memory_bytes += component->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+			if (const UStaticMeshComponent* mesh_component = Cast<UStaticMeshComponent>(component))
+			{
+				counts.draw_calls += MeshMerge::sectionCount(mesh_component->GetStaticMesh());
+			}
+		}
+	}
+	return counts;
+}
+
+bool UStayCalmMergeMeshesCommandlet::writeReport(const FString& map_name, const level_counts& before, const level_counts& after,
+	const TArray<group_report>& groups, const FString& output_path)
+{
+	FString csv = TEXT("map,mesh,instances,draw_calls_before,draw_calls_after\n");
+	csv += FString::Printf(TEXT("%s,total,%d,%d,%d\n"), *map_name, before.actors - after.actors, before.draw_calls, after.draw_calls);
+	for (const group_report& group : groups)
+	{
+		csv += FString::Printf(TEXT("%s,%s,%d,%d,%d\n"), *map_name, *group.mesh, group.instances, group.draw_calls_before, group.draw_calls_after);
+	}
+
+	//Merging throws away the merged actors' lightmaps, so any merge needs lighting rebuilt
+	const bool lighting_rebuild_required = groups.Num() > 0;
+	const FString json = FString::Printf(TEXT("{\n\t\"map\": \"%s\",\n\t\"groups\": %d,\n\t\"lighting_rebuild_required\": %s,\n")
+		TEXT("\t\"before\": { \"actors\": %d, \"draw_calls\": %d, \"memory_bytes\": %llu },\n")
+		TEXT("\t\"after\": { \"actors\": %d, \"draw_calls\": %d, \"memory_bytes\": %llu }\n}\n"),
+		*map_name, groups.Num(), lighting_rebuild_required ? TEXT("true") : TEXT("false"),
+		before.actors, before.draw_calls, (uint64)before.memory_bytes,
+		after.actors, after.draw_calls, (uint64)after.memory_bytes);
+
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(output_path), true);
+	const FString csv_path = output_path + TEXT(".csv");
+	const FString json_path = output_path + TEXT(".json");
+	if (!FFileHelper::SaveStringToFile(csv, *csv_path) || !FFileHelper::SaveStringToFile(json, *json_path))
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("Could not write merge report to %s"), *output_path);
+		return false;
+	}
+
+	UE_LOG(LogStayCalm, Display, TEXT("Wrote %s and %s"), *csv_path, *json_path);
+	return true;
+}
+
+#endif
@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "Engine/EngineTypes.h"
+#include "MergeMeshesCommandlet.generated.h"
+
+class AStaticMeshActor;
+class UMaterialInterface;
+class UStaticMesh;
+class UStaticMeshComponent;
+
+/**
+ * Replaces repeated static mesh actors in a map with hierarchical instanced static meshes, one per group of actors that
+ * share a mesh, materials, collision and shadow settings. Collision is copied from the actors, so the trace channels
+ * sensing relies on (PeripherialTriggerObject, PanicTriggerObject, WorldStatic) keep hitting every instance.
+ * Reports actor, estimated draw call and memory counts before and after, per map and per group.
+ * The merged actors' baked lightmaps are lost, so a map that had anything merged needs its lighting rebuilt. The log
+ * warns about this and the report sets lighting_rebuild_required, also on a dry run that found groups to merge.
+ *
+ * Only plain AStaticMeshActors in the persistent level with static mobility are merged. Actors that are attached to or
+ * have other actors attached, or that are tagged NoMerge, are left alone so anything gameplay refers to stays an actor.
+ *
+ * UE4Editor-Cmd StayCalm.uproject -run=StayCalmMergeMeshes -nullrhi -unattended -Maps=Level1_Home
+ *   -Maps=<names>        Comma separated maps, as short names or long package names
+ *   -MinInstances=4      Smallest group that is merged
+ *   -DryRun              Report what would be merged without changing or saving the maps
+ *   -Output=<path>       Report file without extension. Defaults to Saved/MeshMerge/<map>
+ */
+UCLASS()
+class UStayCalmMergeMeshesCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UStayCalmMergeMeshesCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	//Everything two actors must share to be drawn as instances of one mesh
+	struct group_key
+	{
+		UStaticMesh* mesh = nullptr;
+		TArray<UMaterialInterface*> materials;
+		TEnumAsByte<ECollisionEnabled::Type> collision_enabled = ECollisionEnabled::NoCollision;
+		TEnumAsByte<ECollisionChannel> object_type = ECC_WorldStatic;
+		FCollisionResponseContainer responses;
+		FName collision_profile;
+		bool generate_overlap_events = false;
+		bool cast_shadow = true;
+		float max_draw_distance = 0.0f;
+
+		bool operator==(const group_key& other) const;
+
+		uint32 hash() const;
+
+		friend uint32 GetTypeHash(const group_key& key) { return key.hash(); }
+	};
+
+	struct level_counts
+	{
+		int32 actors = 0;
+		int32 draw_calls = 0;
+		SIZE_T memory_bytes = 0;
+	};
+
+	struct group_report
+	{
+		FString mesh;
+		int32 instances = 0;
+		int32 draw_calls_before = 0;
+		int32 draw_calls_after = 0;
+	};
+
+	//Merges one map and writes its report. Returns false if the map could not be loaded or saved.
+	bool mergeMap(const FString& map_name, int32 min_instances, bool dry_run, const FString& output_path);
+
+	//Null if the actor should not be merged
+	static UStaticMeshComponent* mergeableComponent(AStaticMeshActor* actor);
+
+	static group_key keyFor(const UStaticMeshComponent* component);
+
+	//Actors in the level, with mesh draw calls estimated as one per LOD0 section of each static mesh component
+	static level_counts countLevel(const ULevel* level);
+
+	static bool writeReport(const FString& map_name, const level_counts& before, const level_counts& after,
+		const TArray<group_report>& groups, const FString& output_path);
+};
@@ -0,0 +1,103 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicEventBus.h"
+#include "Engine/World.h"
+#include "PanicTrigger.h"
+#include "StayCalm.h"
+
+DECLARE_CYCLE_STAT(TEXT("Dispatch Panic Events"), STAT_DispatchPanicEvents, STATGROUP_StayCalm);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Panic Sight Events"), STAT_PanicSightEvents, STATGROUP_StayCalm);
+
+void FPanicEventDispatchTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (target != nullptr)
+	{
+		target->dispatch();
+	}
+}
+
+FString FPanicEventDispatchTickFunction::DiagnosticMessage()
+{
+	return TEXT("UPanicEventBus::dispatch");
+}
+
+void UPanicEventBus::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	//After physics, so the character's sensing and any async results from the start of the frame are all in
+	dispatch_tick.target = this;
+	dispatch_tick.TickGroup = TG_PostPhysics;
+	dispatch_tick.bCanEverTick = true;
+	dispatch_tick.bStartWithTickEnabled = true;
+	dispatch_tick.bTickEvenWhenPaused = false;
+	dispatch_tick.RegisterTickFunction(InWorld.PersistentLevel);
+}
+
+void UPanicEventBus::Deinitialize()
+{
+	if (dispatch_tick.IsTickFunctionRegistered())
+	{
+		dispatch_tick.UnRegisterTickFunction();
+	}
+	dispatch_tick.target = nullptr;
+
+	pending_events.Reset();
+	on_sight_events.Clear();
+
+	Super::Deinitialize();
+}
+
+void UPanicEventBus::postSight(APanicTrigger* trigger, bool peripherial)
+{
+	if (trigger == nullptr)
+	{
+		return;
+	}
+
+	FPanicSightEvent event;
+	event.trigger = trigger;
+	event.peripherial = peripherial;
+	event.active = trigger->get_panic_trigger_active();
+	event.panic_level = trigger->get_panic_level();
+
+	//Only a handful of triggers are in sight at once, so a linear search beats a map
+	FPanicSightEvent* existing = pending_events.FindByPredicate([trigger](const FPanicSightEvent& pending)
+	{
+		return pending.trigger == trigger;
+	});
+
+	if (existing == nullptr)
+	{
+		LLM_SCOPE_BYTAG(StayCalm_Sensing);
+		pending_events.Add(event);
+	}
+	else if (event.priority() > existing->priority())
+	{
+		*existing = event;
+	}
+}
+
+void UPanicEventBus::dispatch()
+{
+	if (pending_events.Num() == 0)
+	{
+		return;
+	}
+
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_DispatchPanicEvents);
+	SET_DWORD_STAT(STAT_PanicSightEvents, pending_events.Num());
+
+	//Highest priority first, so subscribers that only act on one sighting can take the first
+	pending_events.Sort([](const FPanicSightEvent& a, const FPanicSightEvent& b)
+	{
+		return a.priority() > b.priority();
+	});
+
+	//Subscribers may post again while handling, which lands in next frame's dispatch
+	TArray<FPanicSightEvent> events = MoveTemp(pending_events);
+	pending_events.Reset();
+
+	on_sight_events.Broadcast(events);
+}
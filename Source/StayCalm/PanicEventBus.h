@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "PanicEventBus.generated.h"
+
+class APanicTrigger;
+class UPanicEventBus;
+
+/**
+ * A trigger reached by sensing this frame
+ */
+USTRUCT(BlueprintType)
+struct STAYCALM_API FPanicSightEvent
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = Panic)
+	APanicTrigger* trigger = nullptr;
+
+	//True if only peripherial vision reached the trigger
+	UPROPERTY(BlueprintReadOnly, Category = Panic)
+	bool peripherial = true;
+
+	//True if the trigger was active, so the sighting can start panic
+	UPROPERTY(BlueprintReadOnly, Category = Panic)
+	bool active = false;
+
+	UPROPERTY(BlueprintReadOnly, Category = Panic)
+	int32 panic_level = 0;
+
+	//Active sightings outrank inactive ones, then main sight outranks peripherial, then higher panic levels win
+	int32 priority() const
+	{
+		return ((active ? 2 : 0) + (peripherial ? 0 : 1)) * 1024 + FMath::Clamp(panic_level, 0, 1023);
+	}
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnPanicSightEvents, const TArray<FPanicSightEvent>&);
+
+/**
+ * Runs the event bus dispatch once per frame in its tick group
+ */
+USTRUCT()
+struct FPanicEventDispatchTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	UPanicEventBus* target = nullptr;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FPanicEventDispatchTickFunction> : public TStructOpsTypeTraitsBase2<FPanicEventDispatchTickFunction>
+{
+	enum
+	{
+		WithCopy = false
+	};
+};
+
+/**
+ * Collects every sensing hit made during a frame and hands them out once, at TG_PostPhysics.
+ * A trigger reached by several rays, or by both peripherial and main sight, appears once with its highest priority sighting.
+ * Synchronous hits from the character's tick and async hits delivered at the start of the frame land in the same dispatch.
+ */
+UCLASS()
+class STAYCALM_API UPanicEventBus : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+
+	virtual void Deinitialize() override;
+
+	//Records that sensing reached the trigger this frame. Keeps whichever sighting of the trigger has the higher priority.
+	void postSight(APanicTrigger* trigger, bool peripherial);
+
+	//Broadcasts this frame's sightings, if any, and clears them. Called by the dispatch tick function.
+	void dispatch();
+
+	//Broadcast once per frame with every trigger sighted that frame. Not broadcast on frames without sightings.
+	FOnPanicSightEvents on_sight_events;
+
+private:
+	UPROPERTY()
+	TArray<FPanicSightEvent> pending_events;
+
+	FPanicEventDispatchTickFunction dispatch_tick;
+};
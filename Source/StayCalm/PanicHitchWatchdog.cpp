@@ -0,0 +1,208 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicHitchWatchdog.h"
+#include "StayCalm.h"
+#include "PanicTriggerSubsystem.h"
+#include "Async/Async.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectGlobals.h"
+
+static TAutoConsoleVariable<float> CVarStayCalmHitchBudget(
+	TEXT("StayCalm.Hitch.BudgetMs"),
+	50.0f,
+	TEXT("Game thread frame time in milliseconds above which the last frames are written to Saved/Hitches. 0 turns the watchdog off."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarStayCalmHitchCooldown(
+	TEXT("StayCalm.Hitch.CooldownSeconds"),
+	10.0f,
+	TEXT("Least time between two hitch captures, so a run of slow frames is written once."),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorld StayCalmHitchDumpCommand(
+	TEXT("StayCalm.Hitch.Dump"),
+	TEXT("Writes the recent frame context to Saved/Hitches without waiting for a hitch."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+	{
+		if (UPanicHitchWatchdog* watchdog = world != nullptr ? world->GetSubsystem<UPanicHitchWatchdog>() : nullptr)
+		{
+			watchdog->dump(TEXT("requested"));
+		}
+	}));
+
+bool UPanicHitchWatchdog::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* world = Cast<UWorld>(Outer);
+	return world != nullptr && world->IsGameWorld();
+}
+
+void UPanicHitchWatchdog::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	ring.Reserve(ring_capacity);
+	has_ticked = false;
+
+	garbage_collected_handle = FCoreUObjectDelegates::GetPostGarbageCollect().AddUObject(this, &UPanicHitchWatchdog::onGarbageCollected);
+	level_added_handle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UPanicHitchWatchdog::onLevelAdded);
+	level_removed_handle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UPanicHitchWatchdog::onLevelRemoved);
+}
+
+void UPanicHitchWatchdog::Deinitialize()
+{
+	FCoreUObjectDelegates::GetPostGarbageCollect().Remove(garbage_collected_handle);
+	FWorldDelegates::LevelAddedToWorld.Remove(level_added_handle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(level_removed_handle);
+
+	Super::Deinitialize();
+}
+
+void UPanicHitchWatchdog::noteEvent(const UObject* world_context, PanicHitchEvent::Type event)
+{
+	const UWorld* world = world_context != nullptr ? world_context->GetWorld() : nullptr;
+	if (UPanicHitchWatchdog* watchdog = world != nullptr ? world->GetSubsystem<UPanicHitchWatchdog>() : nullptr)
+	{
+		watchdog->noteEvent(event);
+	}
+}
+
+void UPanicHitchWatchdog::onGarbageCollected()
+{
+	noteEvent(PanicHitchEvent::GarbageCollected);
+}
+
+void UPanicHitchWatchdog::onLevelAdded(ULevel* level, UWorld* world)
+{
+	if (world == GetWorld())
+	{
+		noteEvent(PanicHitchEvent::LevelAdded);
+	}
+}
+
+void UPanicHitchWatchdog::onLevelRemoved(ULevel* level, UWorld* world)
+{
+	if (world == GetWorld())
+	{
+		noteEvent(PanicHitchEvent::LevelRemoved);
+	}
+}
+
+void UPanicHitchWatchdog::Tick(float DeltaTime)
+{
+	const double now = FPlatformTime::Seconds();
+
+	//The time since Initialize covers loading the map, which is not a frame the game can hitch in
+	if (!has_ticked)
+	{
+		has_ticked = true;
+		last_tick_seconds = now;
+		current.events = 0;
+		current.traces = 0;
+		return;
+	}
+
+	current.frame_number = GFrameCounter;
+	current.frame_ms = (float)((now - last_tick_seconds) * 1000.0);
+	last_tick_seconds = now;
+
+	if (const UPanicTriggerSubsystem* registry = GetWorld()->GetSubsystem<UPanicTriggerSubsystem>())
+	{
+		current.trigger_count = registry->getTriggers().Num();
+	}
+
+	if (ring.Num() < ring_capacity)
+	{
+		ring.Add(current);
+	}
+	else
+	{
+		ring[head] = current;
+		head = (head + 1) % ring_capacity;
+	}
+
+	const float budget_ms = CVarStayCalmHitchBudget.GetValueOnGameThread();
+	if (budget_ms > 0.0f && current.frame_ms > budget_ms && now - last_dump_seconds >= CVarStayCalmHitchCooldown.GetValueOnGameThread())
+	{
+		dump(TEXT("over budget"), current.frame_ms);
+	}
+
+	//Panic level and queue depth carry over until the character reports again
+	const int32 panic_level = current.panic_level;
+	const int32 movement_delay_segments = current.movement_delay_segments;
+	current = frame_context();
+	current.panic_level = panic_level;
+	current.movement_delay_segments = movement_delay_segments;
+}
+
+void UPanicHitchWatchdog::dump(const TCHAR* reason, float hitch_ms)
+{
+	static const TCHAR* const event_names[] =
+	{
+		TEXT("widget_created"),
+		TEXT("widget_shown"),
+		TEXT("widget_hidden"),
+		TEXT("panic_started"),
+		TEXT("heartbeat_started"),
+		TEXT("trigger_activated"),
+		TEXT("garbage_collected"),
+		TEXT("level_added"),
+		TEXT("level_removed"),
+	};
+
+	last_dump_seconds = FPlatformTime::Seconds();
+
+	FString csv = TEXT("frame,frame_ms,panic_level,triggers,movement_delay_segments,traces,events\n");
+	for (int32 index = 0; index < ring.Num(); index++)
+	{
+		const frame_context& frame = ring[(head + index) % ring.Num()];
+
+		FString events;
+		for (int32 bit = 0; bit < UE_ARRAY_COUNT(event_names); bit++)
+		{
+			if (frame.events & (1u << bit))
+			{
+				events += events.IsEmpty() ? event_names[bit] : FString(TEXT("|")) + event_names[bit];
+			}
+		}
+
+		csv += FString::Printf(TEXT("%llu,%.2f,%d,%d,%d,%d,%s\n"),
+			frame.frame_number, frame.frame_ms, frame.panic_level, frame.trigger_count, frame.movement_delay_segments, frame.traces, *events);
+	}
+
+	const FString path = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Hitches"), FString::Printf(TEXT("Hitch-%s-%llu.csv"), *FDateTime::Now().ToString(), GFrameCounter));
+	if (hitch_ms > 0.0f)
+	{
+		UE_LOG(LogStayCalm, Warning, TEXT("Frame took %.2fms (%s). Writing the last %d frames to %s"), hitch_ms, reason, ring.Num(), *path);
+	}
+	else
+	{
+		UE_LOG(LogStayCalm, Display, TEXT("Hitch capture %s. Writing the last %d frames to %s"), reason, ring.Num(), *path);
+	}
+
+	//Writing on the game thread would add to the hitch being captured
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [path, csv = MoveTemp(csv)]()
+	{
+		FFileHelper::SaveStringToFile(csv, *path);
+	});
+}
+
+ETickableTickType UPanicHitchWatchdog::GetTickableTickType() const
+{
+	//The class default object is never part of a world
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+UWorld* UPanicHitchWatchdog::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+TStatId UPanicHitchWatchdog::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPanicHitchWatchdog, STATGROUP_StayCalm);
+}
@@ -0,0 +1,107 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "PanicHitchWatchdog.generated.h"
+
+//Gameplay events that can cause a hitch. Several can happen in one frame.
+namespace PanicHitchEvent
+{
+	enum Type : uint32
+	{
+		WidgetCreated = 1 << 0,
+		WidgetShown = 1 << 1,
+		WidgetHidden = 1 << 2,
+		PanicStarted = 1 << 3,
+		HeartbeatStarted = 1 << 4,
+		TriggerActivated = 1 << 5,
+		GarbageCollected = 1 << 6,
+		LevelAdded = 1 << 7,
+		LevelRemoved = 1 << 8,
+	};
+}
+
+/**
+ * Watches game thread frame time against a budget and keeps a ring of recent frames with the gameplay state and events
+ * seen in each. When a frame goes over budget the ring is written to Saved/Hitches so the spike can be matched to what
+ * the game was doing, e.g. a pause menu widget being created or the heartbeat restarting.
+ * A frame here is the time between two ticks of the watchdog, so everything that happened in it, including garbage
+ * collection at the end of the engine frame, lands in the same entry.
+ */
+UCLASS()
+class STAYCALM_API UPanicHitchWatchdog : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickableWhenPaused() const override { return true; }
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	inline void noteEvent(PanicHitchEvent::Type event) { current.events |= event; }
+
+	//Records an event with the watchdog of the object's world, if there is one
+	static void noteEvent(const UObject* world_context, PanicHitchEvent::Type event);
+
+	inline void noteTraces(int32 count) { current.traces += count; }
+
+	//Called by the character every frame
+	inline void noteCharacterState(int32 panic_level, int32 movement_delay_segments)
+	{
+		current.panic_level = panic_level;
+		current.movement_delay_segments = movement_delay_segments;
+	}
+
+	//Writes the ring to disk now. hitch_ms is the length of the frame that went over budget, or 0 when the dump was requested.
+	void dump(const TCHAR* reason, float hitch_ms = 0.0f);
+
+private:
+	struct frame_context
+	{
+		uint64 frame_number = 0;
+		float frame_ms = 0.0f;
+		int32 panic_level = 0;
+		int32 trigger_count = 0;
+		int32 movement_delay_segments = 0;
+		int32 traces = 0;
+		uint32 events = 0;
+	};
+
+	static constexpr int32 ring_capacity = 120;
+
+	void onGarbageCollected();
+
+	void onLevelAdded(ULevel* level, UWorld* world);
+
+	void onLevelRemoved(ULevel* level, UWorld* world);
+
+	//Most recent frames. Once full, head is the oldest.
+	TArray<frame_context> ring;
+
+	int32 head = 0;
+
+	//Frame being gathered since the last tick
+	frame_context current;
+
+	double last_tick_seconds = 0.0;
+
+	//The first tick only starts timing
+	bool has_ticked = false;
+
+	double last_dump_seconds = -DBL_MAX;
+
+	FDelegateHandle garbage_collected_handle;
+	FDelegateHandle level_added_handle;
+	FDelegateHandle level_removed_handle;
+};
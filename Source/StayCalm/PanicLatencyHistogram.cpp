@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicLatencyHistogram.h"
+
+void FPanicLatencyHistogram::record(int32 panic_level, float actual_seconds, float target_seconds)
+{
+	panic_level = FMath::Max(panic_level, 0);
+	if (!levels.IsValidIndex(panic_level))
+	{
+		levels.SetNum(panic_level + 1);
+	}
+
+	level_histogram& level = levels[panic_level];
+	if (level.bins.Num() == 0)
+	{
+		level.bins.SetNumZeroed(bin_count);
+	}
+
+	const float actual_ms = actual_seconds * 1000.0f;
+	const float target_ms = target_seconds * 1000.0f;
+	const float error_ms = actual_ms - target_ms;
+
+	level.bins[FMath::Clamp(FMath::FloorToInt(actual_ms / bin_ms), 0, bin_count - 1)]++;
+	level.count++;
+	level.total_target_ms += target_ms;
+	level.total_actual_ms += actual_ms;
+	level.total_error_ms += error_ms;
+	level.total_absolute_error_ms += FMath::Abs(error_ms);
+	level.max_absolute_error_ms = FMath::Max(level.max_absolute_error_ms, FMath::Abs(error_ms));
+
+	last_error_ms = error_ms;
+}
+
+void FPanicLatencyHistogram::reset()
+{
+	levels.Reset();
+	last_error_ms = 0.0f;
+}
+
+float FPanicLatencyHistogram::level_histogram::percentileMs(float fraction) const
+{
+	const uint32 rank = FMath::Max<uint32>(1, FMath::CeilToInt(fraction * count));
+	uint32 seen = 0;
+	for (int32 bin = 0; bin < bins.Num(); bin++)
+	{
+		seen += bins[bin];
+		if (seen >= rank)
+		{
+			return (bin + 1) * bin_ms;
+		}
+	}
+	return bins.Num() * bin_ms;
+}
+
+void FPanicLatencyHistogram::dump(FOutputDevice& output) const
+{
+	output.Logf(TEXT("Movement delay by panic level (ms, %.0fms bins)"), bin_ms);
+	output.Logf(TEXT("%5s %7s %8s %8s %8s %8s %8s %10s %10s"), TEXT("level"), TEXT("count"), TEXT("target"), TEXT("mean"), TEXT("p50"), TEXT("p95"), TEXT("p99"), TEXT("mean err"), TEXT("max |err|"));
+
+	for (int32 panic_level = 0; panic_level < levels.Num(); panic_level++)
+	{
+		const level_histogram& level = levels[panic_level];
+		if (level.count == 0)
+		{
+			continue;
+		}
+
+		output.Logf(TEXT("%5d %7u %8.1f %8.1f %8.1f %8.1f %8.1f %10.1f %10.1f"),
+			panic_level, level.count,
+			level.total_target_ms / level.count,
+			level.total_actual_ms / level.count,
+			level.percentileMs(0.50f), level.percentileMs(0.95f), level.percentileMs(0.99f),
+			level.total_error_ms / level.count,
+			level.max_absolute_error_ms);
+	}
+}
@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Histogram of the movement delay players actually get, kept per panic level next to the delay that was intended.
+ * A sample is the time from a change in movement input arriving to that change being applied with AddMovementInput,
+ * so frame quantization and anything else that skews the delay shows up as error against the target.
+ */
+class STAYCALM_API FPanicLatencyHistogram
+{
+public:
+	//Width of each bin in milliseconds
+	static constexpr float bin_ms = 5.0f;
+
+	//Delays past the last bin are counted in it
+	static constexpr int32 bin_count = 400;
+
+	void record(int32 panic_level, float actual_seconds, float target_seconds);
+
+	void reset();
+
+	//Prints count, target, actual percentiles and error for every panic level with samples
+	void dump(FOutputDevice& output) const;
+
+	//Error in milliseconds of the last sample recorded
+	inline float lastErrorMs() const { return last_error_ms; }
+
+private:
+	struct level_histogram
+	{
+		TArray<uint32> bins;
+		uint32 count = 0;
+		double total_target_ms = 0.0;
+		double total_actual_ms = 0.0;
+		double total_error_ms = 0.0;
+		double total_absolute_error_ms = 0.0;
+		float max_absolute_error_ms = 0.0f;
+
+		//Upper edge in milliseconds of the bin holding the given fraction of samples
+		float percentileMs(float fraction) const;
+	};
+
+	TArray<level_histogram> levels;
+
+	float last_error_ms = 0.0f;
+};
@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicLookFilter.h"
+
+FVector2D FPanicLookFilter::step(float delta_time, float smooth_time)
+{
+	if (smooth_time <= 0.0f)
+	{
+		const FVector2D released = remaining;
+		reset();
+		return released;
+	}
+
+	if (delta_time <= 0.0f)
+	{
+		return FVector2D::ZeroVector;
+	}
+
+	//Critically damped spring from the released position (0) towards everything added (remaining). Game Programming Gems 4, 1.10.
+	const float omega = 2.0f / smooth_time;
+	const float x = omega * delta_time;
+	const float decay = 1.0f / (1.0f + x + 0.48f * x * x + 0.235f * x * x * x);
+
+	const FVector2D change = -remaining;
+	const FVector2D temp = (velocity + omega * change) * delta_time;
+	velocity = (velocity - omega * temp) * decay;
+
+	const FVector2D released = remaining + (change + temp) * decay;
+	remaining -= released;
+	return released;
+}
+
+bool FPanicLookFilter::isSettled() const
+{
+	return remaining.IsNearlyZero(KINDA_SMALL_NUMBER) && velocity.IsNearlyZero(KINDA_SMALL_NUMBER);
+}
+
+void FPanicLookFilter::reset()
+{
+	remaining = FVector2D::ZeroVector;
+	velocity = FVector2D::ZeroVector;
+}
@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Delays and damps look input with a critically damped spring on yaw and pitch.
+ * Input is added as it arrives and step releases it smoothly over roughly the smoothing time.
+ * Costs the same every frame and holds no per-frame samples.
+ */
+class STAYCALM_API FPanicLookFilter
+{
+public:
+	//Adds look input (X yaw, Y pitch) to be released by later steps
+	inline void addInput(const FVector2D& yaw_pitch) { remaining += yaw_pitch; }
+
+	/**
+	* Advances the spring.
+	* @param smooth_time - roughly how long in seconds input takes to be released. 0 releases everything now.
+	* @return The yaw (X) and pitch (Y) to apply this frame
+	**/
+	FVector2D step(float delta_time, float smooth_time);
+
+	//True when there is no input left to release
+	bool isSettled() const;
+
+	void reset();
+
+private:
+	//Input added but not yet released
+	FVector2D remaining = FVector2D::ZeroVector;
+
+	FVector2D velocity = FVector2D::ZeroVector;
+};
@@ -0,0 +1,121 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicPostProcess.h"
+#include "Camera/CameraComponent.h"
+#include "Components/PostProcessComponent.h"
+#include "Materials/MaterialParameterCollectionInstance.h"
+#include "StayCalm.h"
+
+DECLARE_CYCLE_STAT(TEXT("Panic Post Process"), STAT_PanicPostProcess, STATGROUP_StayCalm);
+
+namespace
+{
+	const FName blur_parameter(TEXT("PanicBlur"));
+	const FName depth_parameter(TEXT("PanicDepth"));
+
+	//Engine defaults, used when calm
+	constexpr float calm_vignette_intensity = 0.4f;
+	constexpr float calm_depth_blur_km = 1.0f;
+
+	//Effects closer than this to their target snap to it so updates stop
+	constexpr float settle_threshold = 0.001f;
+}
+
+void FPanicPostProcessController::initialize(const FPanicPostProcessSettings& in_settings, UPostProcessComponent* in_post_process, UCameraComponent* in_camera, UMaterialParameterCollectionInstance* in_parameters)
+{
+	settings = in_settings;
+	post_process = in_post_process;
+	camera = in_camera;
+	parameters = in_parameters;
+
+	if (in_camera != nullptr)
+	{
+		base_field_of_view = in_camera->FieldOfView;
+	}
+
+	if (in_post_process != nullptr)
+	{
+		//The panic effects follow the character everywhere. The blend weight fades them in, so the level's own
+		//post process settings are untouched while calm.
+		in_post_process->bUnbound = true;
+		in_post_process->BlendWeight = 0.0f;
+
+		FPostProcessSettings& post_process_settings = in_post_process->Settings;
+		post_process_settings.bOverride_DepthOfFieldDepthBlurRadius = true;
+		post_process_settings.bOverride_DepthOfFieldDepthBlurAmount = true;
+		post_process_settings.bOverride_SceneFringeIntensity = true;
+		post_process_settings.bOverride_VignetteIntensity = true;
+	}
+
+	blur = target_blur = 0.0f;
+	depth = target_depth = 0.0f;
+	apply();
+}
+
+void FPanicPostProcessController::setLevels(int32 blur_level, int32 depth_level)
+{
+	target_blur = FMath::Clamp((float)blur_level / settings.max_blur_level, 0.0f, 1.0f);
+	target_depth = FMath::Clamp((float)depth_level / settings.max_depth_level, 0.0f, 1.0f);
+}
+
+void FPanicPostProcessController::update(float delta_time)
+{
+	if (isSettled())
+	{
+		return;
+	}
+
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_PanicPostProcess);
+
+	//Exponential ease, so the result does not depend on frame rate
+	const float blend = 1.0f - FMath::Exp(-settings.blend_speed * delta_time);
+	blur = FMath::Lerp(blur, target_blur, blend);
+	depth = FMath::Lerp(depth, target_depth, blend);
+
+	if (FMath::Abs(target_blur - blur) < settle_threshold)
+	{
+		blur = target_blur;
+	}
+	if (FMath::Abs(target_depth - depth) < settle_threshold)
+	{
+		depth = target_depth;
+	}
+
+	apply();
+}
+
+void FPanicPostProcessController::apply()
+{
+	if (UPostProcessComponent* component = post_process.Get())
+	{
+		//The stronger effect sets the blend weight and each effect is scaled relative to it, so blur and depth still
+		//ease in and out on their own
+		const float weight = FMath::Max(blur, depth);
+		component->BlendWeight = weight;
+		if (weight > 0.0f)
+		{
+			const float blur_share = blur / weight;
+			const float depth_share = depth / weight;
+
+			FPostProcessSettings& post_process_settings = component->Settings;
+			post_process_settings.DepthOfFieldDepthBlurRadius = settings.depth_blur_radius * blur_share;
+			post_process_settings.SceneFringeIntensity = settings.fringe_intensity * blur_share;
+			post_process_settings.VignetteIntensity = FMath::Lerp(calm_vignette_intensity, settings.vignette_intensity, blur_share);
+
+			//Blend in log space so the blur moves in at an even pace across the large range of distances
+			post_process_settings.DepthOfFieldDepthBlurAmount = FMath::Exp(FMath::Lerp(FMath::Loge(calm_depth_blur_km), FMath::Loge(settings.depth_blur_km), depth_share));
+		}
+	}
+
+	if (UCameraComponent* camera_component = camera.Get())
+	{
+		camera_component->SetFieldOfView(base_field_of_view - (settings.field_of_view_narrowing * depth));
+	}
+
+	if (UMaterialParameterCollectionInstance* parameter_instance = parameters.Get())
+	{
+		parameter_instance->SetScalarParameterValue(blur_parameter, blur);
+		parameter_instance->SetScalarParameterValue(depth_parameter, depth);
+	}
+}
@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PanicPostProcess.generated.h"
+
+class UCameraComponent;
+class UMaterialParameterCollectionInstance;
+class UPostProcessComponent;
+
+/**
+ * How panic blur and depth perception look. Values are for the highest level; calm leaves the level's own post process alone.
+ */
+USTRUCT(BlueprintType)
+struct STAYCALM_API FPanicPostProcessSettings
+{
+	GENERATED_BODY()
+
+	//Blur and depth levels that map to the full effect
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1"))
+	int32 max_blur_level = 3;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1"))
+	int32 max_depth_level = 3;
+
+	//How quickly effects follow a level change. Higher is faster.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.1"))
+	float blend_speed = 2.0f;
+
+	//Depth of field blur radius in pixels at 1080p at the highest blur level
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0"))
+	float depth_blur_radius = 6.0f;
+
+	//Chromatic aberration at the highest blur level
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0", ClampMax = "5.0"))
+	float fringe_intensity = 3.0f;
+
+	//Vignette at the highest blur level
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float vignette_intensity = 0.9f;
+
+	//Distance in km at which depth of field blur is half strength at the highest depth level. Lower pulls the blur closer.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.000001"))
+	float depth_blur_km = 0.02f;
+
+	//Degrees taken off the camera field of view at the highest depth level
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0", ClampMax = "60.0"))
+	float field_of_view_narrowing = 12.0f;
+};
+
+/**
+ * Drives the panic post process natively: depth of field, vignette, chromatic aberration and field of view, plus
+ * PanicBlur and PanicDepth (0 to 1) in a material parameter collection for materials that react to panic.
+ * The post process component's blend weight follows the stronger effect, so nothing is overridden while calm.
+ * Levels are set when they change and the effects ease towards them over time. Each update costs the same handful of
+ * blends and writes, and nothing is written once the effects have settled.
+ */
+class STAYCALM_API FPanicPostProcessController
+{
+public:
+	/**
+	* @param in_parameters - may be null when no parameter collection is set
+	**/
+	void initialize(const FPanicPostProcessSettings& in_settings, UPostProcessComponent* in_post_process, UCameraComponent* in_camera, UMaterialParameterCollectionInstance* in_parameters);
+
+	void setLevels(int32 blur_level, int32 depth_level);
+
+	//Eases the effects towards the current levels. Called every frame.
+	void update(float delta_time);
+
+	inline bool isSettled() const { return blur == target_blur && depth == target_depth; }
+
+	//Current effect strengths, 0 when calm and 1 at the highest level
+	inline float getBlur() const { return blur; }
+	inline float getDepth() const { return depth; }
+
+private:
+	void apply();
+
+	FPanicPostProcessSettings settings;
+
+	TWeakObjectPtr<UPostProcessComponent> post_process;
+
+	TWeakObjectPtr<UCameraComponent> camera;
+
+	TWeakObjectPtr<UMaterialParameterCollectionInstance> parameters;
+
+	//Field of view of the camera when calm
+	float base_field_of_view = 90.0f;
+
+	float blur = 0.0f;
+	float depth = 0.0f;
+
+	float target_blur = 0.0f;
+	float target_depth = 0.0f;
+};
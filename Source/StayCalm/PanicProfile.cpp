@@ -0,0 +1,25 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicProfile.h"
+
+UPanicProfile::UPanicProfile()
+{
+	//New profiles start as a copy of the built-in levels
+	levels.Append(PanicProfileDefaults::levels, PanicProfileDefaults::num_levels);
+}
+
+const FPanicSymptoms& UPanicProfile::symptomsForLevel(int32 level) const
+{
+	if (levels.Num() == 0)
+	{
+		return PanicProfileDefaults::symptomsForLevel(level);
+	}
+
+	return levels[FMath::Clamp(level, 0, levels.Num() - 1)];
+}
+
+int32 UPanicProfile::maxLevel() const
+{
+	return (levels.Num() > 0 ? levels.Num() : PanicProfileDefaults::num_levels) - 1;
+}
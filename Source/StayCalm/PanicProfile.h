@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "PanicSymptoms.h"
+#include "PanicProfile.generated.h"
+
+namespace PanicProfileDefaults
+{
+	//Built-in panic levels, indexed by panic level. Used when the character has no panic profile asset.
+	constexpr FPanicSymptoms levels[] =
+	{
+		//         blur, depth, heartbeat, delay, speed
+		FPanicSymptoms(0, 0, 0.0f, 0.0f, 1.0f),
+		FPanicSymptoms(1, 0, 0.5f, 0.0f, 1.0f),
+		FPanicSymptoms(1, 1, 0.5f, 0.5f, 1.5f),
+		FPanicSymptoms(2, 2, 1.5f, 0.75f, 2.0f),
+		FPanicSymptoms(3, 2, 2.0f, 0.75f, 2.0f),
+		FPanicSymptoms(3, 3, 3.0f, 1.0f, 3.0f),
+	};
+
+	constexpr int32 num_levels = UE_ARRAY_COUNT(levels);
+
+	static_assert(levels[0].blur_level == 0 && levels[0].depth_level == 0 && levels[0].heartbeat_volume == 0.0f && levels[0].movement_time_delay == 0.0f,
+		"Panic level 0 must be calm");
+
+	//Looks up a built-in level. Levels past the end use the highest level.
+	constexpr const FPanicSymptoms& symptomsForLevel(int32 level)
+	{
+		return levels[level <= 0 ? 0 : (level >= num_levels ? num_levels - 1 : level)];
+	}
+}
+
+/**
+ * Designer-authored panic levels. Index 0 is calm and each following entry is the next panic level,
+ * so levels can be added without code changes.
+ */
+UCLASS(BlueprintType)
+class STAYCALM_API UPanicProfile : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	UPanicProfile();
+
+	//Symptoms for each panic level, starting with level 0
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Panic)
+	TArray<FPanicSymptoms> levels;
+
+	/**
+	* Looks up the symptoms for a panic level. Levels past the end use the highest level.
+	* Falls back to the built-in levels if the profile is empty.
+	**/
+	const FPanicSymptoms& symptomsForLevel(int32 level) const;
+
+	//Highest panic level in the profile
+	int32 maxLevel() const;
+};
@@ -0,0 +1,595 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicRoomSubsystem.h"
+#include "PanicRoomVolume.h"
+#include "StayCalm.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/AudioComponent.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/Volume.h"
+
+DECLARE_CYCLE_STAT(TEXT("Update Rooms"), STAT_UpdateRooms, STATGROUP_StayCalm);
+DECLARE_CYCLE_STAT(TEXT("Rebuild Rooms"), STAT_RebuildRooms, STATGROUP_StayCalm);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Awake Rooms"), STAT_AwakeRooms, STATGROUP_StayCalm);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Dormant Actors"), STAT_DormantActors, STATGROUP_StayCalm);
+
+static TAutoConsoleVariable<int32> CVarStayCalmRoomsEnabled(
+	TEXT("StayCalm.Rooms.Enabled"),
+	1,
+	TEXT("0: every room is awake.\n")
+	TEXT("1: actors in rooms the player cannot see into are dormant."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarStayCalmRoomsSleepDelay(
+	TEXT("StayCalm.Rooms.SleepDelay"),
+	2.0f,
+	TEXT("Seconds a room stays awake after it goes out of view, so walking back and forth through a doorway does not keep waking it."),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorldAndArgs StayCalmRoomsDumpCommand(
+	TEXT("StayCalm.Rooms.Dump"),
+	TEXT("Prints each room with its portals, actors and whether it is awake."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+	{
+		if (const UPanicRoomSubsystem* room_graph = world != nullptr ? world->GetSubsystem<UPanicRoomSubsystem>() : nullptr)
+		{
+			room_graph->dump(*GLog);
+		}
+	}));
+
+namespace PanicRooms
+{
+	const FName never_dormant_tag(TEXT("NeverDormant"));
+
+	//Seconds between working out which rooms the player can see into
+	constexpr float update_interval = 0.1f;
+
+	//Slack in cm when checking that an actor fits inside a room, for props resting against the walls
+	constexpr float fit_tolerance = 10.0f;
+
+	//Degrees added to half the field of view when checking whether a portal can be seen
+	constexpr float view_margin = 30.0f;
+
+	//Most portals a room can be seen through from the player's room
+	constexpr int32 max_portal_hops = 3;
+}
+
+bool UPanicRoomSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* world = Cast<UWorld>(Outer);
+	return world != nullptr && world->IsGameWorld();
+}
+
+void UPanicRoomSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	//Streamed levels bring their own rooms and props
+	level_added_handle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UPanicRoomSubsystem::onLevelChanged);
+	level_removed_handle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UPanicRoomSubsystem::onLevelChanged);
+}
+
+void UPanicRoomSubsystem::Deinitialize()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(level_added_handle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(level_removed_handle);
+
+	wakeAll();
+	rooms.Reset();
+	portals.Reset();
+	actor_rooms.Reset();
+	movable_actors.Reset();
+	room_volumes.Reset();
+	portal_volumes.Reset();
+
+	Super::Deinitialize();
+}
+
+void UPanicRoomSubsystem::onLevelChanged(ULevel* level, UWorld* world)
+{
+	if (world == GetWorld())
+	{
+		dirty = true;
+	}
+}
+
+void UPanicRoomSubsystem::registerRoom(APanicRoomVolume* room_volume)
+{
+	room_volumes.AddUnique(room_volume);
+	dirty = true;
+}
+
+void UPanicRoomSubsystem::unregisterRoom(APanicRoomVolume* room_volume)
+{
+	room_volumes.Remove(room_volume);
+	dirty = true;
+}
+
+void UPanicRoomSubsystem::registerPortal(APanicPortalVolume* portal_volume)
+{
+	portal_volumes.AddUnique(portal_volume);
+	dirty = true;
+}
+
+void UPanicRoomSubsystem::unregisterPortal(APanicPortalVolume* portal_volume)
+{
+	portal_volumes.Remove(portal_volume);
+	dirty = true;
+}
+
+void UPanicRoomSubsystem::Tick(float DeltaTime)
+{
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_UpdateRooms);
+
+	if (CVarStayCalmRoomsEnabled.GetValueOnGameThread() == 0)
+	{
+		wakeAll();
+		return;
+	}
+
+	//Actors registered during this frame's BeginPlay are picked up on the next tick
+	if (dirty)
+	{
+		rebuild();
+		time_since_update = PanicRooms::update_interval;
+	}
+
+	time_since_update += DeltaTime;
+	if (rooms.Num() == 0 || time_since_update < PanicRooms::update_interval)
+	{
+		return;
+	}
+	const float elapsed = time_since_update;
+	time_since_update = 0.0f;
+
+	placeMovableActors();
+
+	APlayerController* player = GetWorld()->GetFirstPlayerController();
+	if (player == nullptr)
+	{
+		return;
+	}
+
+	FVector view_location;
+	FRotator view_rotation;
+	player->GetPlayerViewPoint(view_location, view_rotation);
+	player_room = roomAt(view_location);
+
+	//Widened so a room is already awake when the player turns towards it between updates
+	const float half_angle = (player->PlayerCameraManager != nullptr ? player->PlayerCameraManager->GetFOVAngle() * 0.5f : 45.0f) + PanicRooms::view_margin;
+	const FVector forward = view_rotation.Vector();
+
+	//Outside every room the room graph says nothing about what can be seen, so everything stays awake
+	TBitArray<> in_view(player_room == INDEX_NONE, rooms.Num());
+	if (player_room != INDEX_NONE)
+	{
+		//Walks out from the player's room through portals that are close by or in view, so rooms seen through a doorway,
+		//or through several lined up doorways, stay awake
+		TArray<TPair<int32, int32>, TInlineAllocator<16>> open_rooms;
+		open_rooms.Emplace(player_room, 0);
+		in_view[player_room] = true;
+		for (int32 open_index = 0; open_index < open_rooms.Num(); open_index++)
+		{
+			//Copied, the array grows while its rooms are walked
+			const TPair<int32, int32> current = open_rooms[open_index];
+			if (current.Value >= PanicRooms::max_portal_hops)
+			{
+				continue;
+			}
+
+			for (int32 portal_index : rooms[current.Key].portals)
+			{
+				const portal& opening = portals[portal_index];
+				const int32 other_room = opening.room_a == current.Key ? opening.room_b : opening.room_a;
+				if (other_room == INDEX_NONE || in_view[other_room])
+				{
+					continue;
+				}
+
+				const bool nearby = opening.bounds.ComputeSquaredDistanceToPoint(view_location) <= FMath::Square(opening.wake_distance);
+				if (nearby || isPortalInView(opening, view_location, forward, half_angle))
+				{
+					in_view[other_room] = true;
+					open_rooms.Emplace(other_room, current.Value + 1);
+				}
+			}
+		}
+	}
+
+	const float sleep_delay = CVarStayCalmRoomsSleepDelay.GetValueOnGameThread();
+	int32 awake_rooms = 0;
+	for (int32 index = 0; index < rooms.Num(); index++)
+	{
+		room& current = rooms[index];
+		if (in_view[index])
+		{
+			current.out_of_view_time = 0.0f;
+			wakeRoom(current);
+		}
+		else if (current.awake)
+		{
+			current.out_of_view_time += elapsed;
+			if (current.out_of_view_time >= sleep_delay)
+			{
+				sleepRoom(current);
+			}
+		}
+		awake_rooms += current.awake ? 1 : 0;
+	}
+	SET_DWORD_STAT(STAT_AwakeRooms, awake_rooms);
+}
+
+void UPanicRoomSubsystem::rebuild()
+{
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_RebuildRooms);
+	LLM_SCOPE_BYTAG(StayCalm);
+
+	wakeAll();
+	dirty = false;
+	rooms.Reset();
+	portals.Reset();
+	actor_rooms.Reset();
+	movable_actors.Reset();
+	player_room = INDEX_NONE;
+
+	for (const TWeakObjectPtr<APanicRoomVolume>& room_volume : room_volumes)
+	{
+		if (room_volume.IsValid())
+		{
+			room& added = rooms.AddDefaulted_GetRef();
+			added.volume = room_volume;
+			added.bounds = room_volume->GetComponentsBoundingBox(true);
+		}
+	}
+
+	for (const TWeakObjectPtr<APanicPortalVolume>& portal_volume : portal_volumes)
+	{
+		if (!portal_volume.IsValid())
+		{
+			continue;
+		}
+
+		portal opening;
+		opening.volume = portal_volume;
+		opening.bounds = portal_volume->GetComponentsBoundingBox(true);
+		opening.wake_distance = portal_volume->wake_distance;
+		opening.room_a = roomIndexOf(portal_volume->room_a);
+		opening.room_b = roomIndexOf(portal_volume->room_b);
+
+		//Rooms not set on the portal are the ones its opening overlaps
+		for (int32 index = 0; index < rooms.Num() && (opening.room_a == INDEX_NONE || opening.room_b == INDEX_NONE); index++)
+		{
+			if (index == opening.room_a || index == opening.room_b || !rooms[index].bounds.Intersect(opening.bounds))
+			{
+				continue;
+			}
+			(opening.room_a == INDEX_NONE ? opening.room_a : opening.room_b) = index;
+		}
+
+		if (opening.room_a == INDEX_NONE && opening.room_b == INDEX_NONE)
+		{
+			UE_LOG(LogStayCalm, Warning, TEXT("Portal %s does not join any rooms"), *portal_volume->GetName());
+			continue;
+		}
+
+		const int32 portal_index = portals.Add(opening);
+		for (int32 room_index : { opening.room_a, opening.room_b })
+		{
+			if (room_index != INDEX_NONE)
+			{
+				rooms[room_index].portals.Add(portal_index);
+			}
+		}
+	}
+
+	if (rooms.Num() == 0)
+	{
+		return;
+	}
+
+	for (TActorIterator<AActor> iterator(GetWorld()); iterator; ++iterator)
+	{
+		AActor* actor = *iterator;
+		if (actor->IsA<AVolume>() || actor->IsA<APawn>() || actor->IsA<AController>() || actor->ActorHasTag(PanicRooms::never_dormant_tag))
+		{
+			continue;
+		}
+
+		//Movable actors can leave their room, e.g. props knocked through a doorway, so they are placed again on every update.
+		//Attached actors go wherever their parent goes.
+		if (actor->IsRootComponentMovable())
+		{
+			if (actor->GetAttachParentActor() == nullptr)
+			{
+				movable_actors.Add(actor);
+			}
+			continue;
+		}
+
+		const int32 index = roomFor(actor, INDEX_NONE);
+		if (index != INDEX_NONE)
+		{
+			rooms[index].actors.Add(actor);
+			actor_rooms.Add(actor, index);
+		}
+	}
+	placeMovableActors();
+
+	UE_LOG(LogStayCalm, Log, TEXT("Room graph: %d rooms, %d portals, %d actors in rooms, %d of them movable"), rooms.Num(), portals.Num(), actor_rooms.Num(), movable_actors.Num());
+}
+
+int32 UPanicRoomSubsystem::roomAt(const FVector& location) const
+{
+	if (player_room != INDEX_NONE && rooms[player_room].volume.IsValid() && rooms[player_room].volume->EncompassesPoint(location))
+	{
+		return player_room;
+	}
+
+	for (int32 index = 0; index < rooms.Num(); index++)
+	{
+		const room& candidate = rooms[index];
+		if (candidate.bounds.IsInsideOrOn(location) && candidate.volume.IsValid() && candidate.volume->EncompassesPoint(location))
+		{
+			return index;
+		}
+	}
+	return INDEX_NONE;
+}
+
+int32 UPanicRoomSubsystem::roomFor(const AActor* actor, int32 current_room) const
+{
+	const FBox actor_bounds = actor->GetComponentsBoundingBox(true);
+	if (!actor_bounds.IsValid)
+	{
+		return INDEX_NONE;
+	}
+
+	auto fits = [this, &actor_bounds](int32 index)
+	{
+		const FBox room_bounds = rooms[index].bounds.ExpandBy(PanicRooms::fit_tolerance);
+		return room_bounds.IsInsideOrOn(actor_bounds.Min) && room_bounds.IsInsideOrOn(actor_bounds.Max)
+			&& rooms[index].volume.IsValid() && rooms[index].volume->EncompassesPoint(actor_bounds.GetCenter());
+	};
+
+	//Most actors stay where they were
+	if (current_room != INDEX_NONE && fits(current_room))
+	{
+		return current_room;
+	}
+
+	for (int32 index = 0; index < rooms.Num(); index++)
+	{
+		if (index != current_room && fits(index))
+		{
+			return index;
+		}
+	}
+	return INDEX_NONE;
+}
+
+void UPanicRoomSubsystem::placeMovableActors()
+{
+	LLM_SCOPE_BYTAG(StayCalm);
+
+	for (int32 movable_index = movable_actors.Num() - 1; movable_index >= 0; movable_index--)
+	{
+		AActor* actor = movable_actors[movable_index].Get();
+		if (actor == nullptr || actor->IsPendingKill())
+		{
+			movable_actors.RemoveAtSwap(movable_index, 1, false);
+			continue;
+		}
+
+		const int32* found = actor_rooms.Find(actor);
+		const int32 from = found != nullptr ? *found : INDEX_NONE;
+		const int32 to = roomFor(actor, from);
+		if (from == to)
+		{
+			continue;
+		}
+
+		//Leaving a dormant room wakes the actor, entering one puts it to sleep with the room
+		if (from != INDEX_NONE)
+		{
+			room& old_room = rooms[from];
+			old_room.actors.RemoveSwap(actor);
+			const int32 state_index = old_room.dormant_actors.IndexOfByPredicate([actor](const dormant_actor& state) { return state.actor.Get() == actor; });
+			if (state_index != INDEX_NONE)
+			{
+				wakeActor(old_room.dormant_actors[state_index]);
+				old_room.dormant_actors.RemoveAtSwap(state_index, 1, false);
+			}
+			actor_rooms.Remove(actor);
+		}
+
+		if (to != INDEX_NONE)
+		{
+			room& new_room = rooms[to];
+			new_room.actors.Add(actor);
+			if (!new_room.awake)
+			{
+				sleepActor(actor, new_room.dormant_actors);
+			}
+			actor_rooms.Add(actor, to);
+		}
+	}
+}
+
+bool UPanicRoomSubsystem::isPortalInView(const portal& opening, const FVector& eye, const FVector& forward, float half_angle)
+{
+	//Bounding sphere of the opening against the view cone
+	const FVector to_center = opening.bounds.GetCenter() - eye;
+	const float distance = to_center.Size();
+	const float radius = opening.bounds.GetExtent().Size();
+	if (distance <= radius)
+	{
+		return true;
+	}
+
+	const float angle = FMath::RadiansToDegrees(FMath::Acos(FMath::Clamp(FVector::DotProduct(forward, to_center / distance), -1.0f, 1.0f)));
+	const float angular_radius = FMath::RadiansToDegrees(FMath::Asin(radius / distance));
+	return angle - angular_radius <= half_angle;
+}
+
+int32 UPanicRoomSubsystem::roomIndexOf(const APanicRoomVolume* volume) const
+{
+	if (volume == nullptr)
+	{
+		return INDEX_NONE;
+	}
+	return rooms.IndexOfByPredicate([volume](const room& candidate) { return candidate.volume.Get() == volume; });
+}
+
+bool UPanicRoomSubsystem::canBeSeen(const AActor* actor) const
+{
+	const int32* index = actor_rooms.Find(actor);
+	return index == nullptr || rooms[*index].awake;
+}
+
+void UPanicRoomSubsystem::sleepRoom(room& sleeping)
+{
+	if (!sleeping.awake)
+	{
+		return;
+	}
+	sleeping.awake = false;
+
+	LLM_SCOPE_BYTAG(StayCalm);
+	sleeping.dormant_actors.Reset(sleeping.actors.Num());
+	for (const TWeakObjectPtr<AActor>& weak_actor : sleeping.actors)
+	{
+		AActor* actor = weak_actor.Get();
+		if (actor != nullptr && !actor->IsPendingKill())
+		{
+			sleepActor(actor, sleeping.dormant_actors);
+		}
+	}
+}
+
+void UPanicRoomSubsystem::sleepActor(AActor* actor, TArray<dormant_actor>& dormant_actors)
+{
+	dormant_actor& state = dormant_actors.AddDefaulted_GetRef();
+	state.actor = actor;
+	state.actor_ticked = actor->IsActorTickEnabled();
+	actor->SetActorTickEnabled(false);
+
+	for (UActorComponent* component : actor->GetComponents())
+	{
+		if (component->IsComponentTickEnabled())
+		{
+			state.ticking_components.Add(component);
+			component->SetComponentTickEnabled(false);
+		}
+
+		if (UAudioComponent* audio = Cast<UAudioComponent>(component))
+		{
+			if (audio->IsPlaying() && !audio->bIsPaused)
+			{
+				state.playing_audio.Add(audio);
+				audio->SetPaused(true);
+			}
+		}
+		else if (UPrimitiveComponent* primitive = Cast<UPrimitiveComponent>(component))
+		{
+			//Only rendering is switched off. Collision stays so nothing falls through or walks into the room.
+			if (primitive->IsVisible())
+			{
+				state.visible_primitives.Add(primitive);
+				primitive->SetVisibility(false);
+			}
+		}
+	}
+	INC_DWORD_STAT(STAT_DormantActors);
+}
+
+void UPanicRoomSubsystem::wakeRoom(room& waking)
+{
+	if (waking.awake)
+	{
+		return;
+	}
+	waking.awake = true;
+
+	for (const dormant_actor& state : waking.dormant_actors)
+	{
+		wakeActor(state);
+	}
+	waking.dormant_actors.Reset();
+}
+
+void UPanicRoomSubsystem::wakeActor(const dormant_actor& state)
+{
+	DEC_DWORD_STAT(STAT_DormantActors);
+	AActor* actor = state.actor.Get();
+	if (actor == nullptr)
+	{
+		return;
+	}
+
+	if (state.actor_ticked)
+	{
+		actor->SetActorTickEnabled(true);
+	}
+	for (const TWeakObjectPtr<UActorComponent>& component : state.ticking_components)
+	{
+		if (component.IsValid())
+		{
+			component->SetComponentTickEnabled(true);
+		}
+	}
+	for (const TWeakObjectPtr<UPrimitiveComponent>& primitive : state.visible_primitives)
+	{
+		if (primitive.IsValid())
+		{
+			primitive->SetVisibility(true);
+		}
+	}
+	for (const TWeakObjectPtr<UAudioComponent>& audio : state.playing_audio)
+	{
+		if (audio.IsValid())
+		{
+			audio->SetPaused(false);
+		}
+	}
+}
+
+void UPanicRoomSubsystem::wakeAll()
+{
+	for (room& current : rooms)
+	{
+		current.out_of_view_time = 0.0f;
+		wakeRoom(current);
+	}
+}
+
+void UPanicRoomSubsystem::dump(FOutputDevice& output) const
+{
+	output.Logf(TEXT("%d rooms, %d portals, player in room %d"), rooms.Num(), portals.Num(), player_room);
+	for (int32 index = 0; index < rooms.Num(); index++)
+	{
+		const room& current = rooms[index];
+		output.Logf(TEXT("  %d %s: %s, %d actors, %d portals"), index, *GetNameSafe(current.volume.Get()),
+			current.awake ? TEXT("awake") : TEXT("dormant"), current.actors.Num(), current.portals.Num());
+	}
+}
+
+ETickableTickType UPanicRoomSubsystem::GetTickableTickType() const
+{
+	//The class default object is never part of a world
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+UWorld* UPanicRoomSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+TStatId UPanicRoomSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPanicRoomSubsystem, STATGROUP_StayCalm);
+}
@@ -0,0 +1,145 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "PanicRoomSubsystem.generated.h"
+
+class APanicPortalVolume;
+class APanicRoomVolume;
+class UAudioComponent;
+
+/**
+ * Puts the actors in rooms the player cannot see into to sleep. The room graph is built from APanicRoomVolume and
+ * APanicPortalVolume actors. The player's room is awake. From there a room wakes when a portal into it from an awake room
+ * is within its wake distance or inside a widened view cone, up to a few portals away. Every other room is dormant.
+ * A dormant actor stops ticking, its components stop ticking, its primitives stop rendering and its playing audio is
+ * paused. Waking restores exactly what was switched off, so anything already off stays off.
+ * Actors are assigned to a room when they fit entirely inside it. Movable actors are placed again on every update, so one
+ * carried into a dormant room sleeps with it and one leaving it wakes. Actors spanning rooms, actors outside every room,
+ * attached actors, pawns, controllers and actors tagged NeverDormant are always awake. With no rooms in the level nothing goes dormant.
+ */
+UCLASS()
+class STAYCALM_API UPanicRoomSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	void registerRoom(APanicRoomVolume* room);
+
+	void unregisterRoom(APanicRoomVolume* room);
+
+	void registerPortal(APanicPortalVolume* portal);
+
+	void unregisterPortal(APanicPortalVolume* portal);
+
+	/**
+	* Cheap occlusion pre-check for sensing
+	* @return False if the actor is in a dormant room, so the player cannot see it
+	**/
+	bool canBeSeen(const AActor* actor) const;
+
+	inline bool hasRooms() const { return rooms.Num() > 0; }
+
+	void wakeAll();
+
+	void dump(FOutputDevice& output) const;
+
+private:
+	//What was switched off on a dormant actor, so waking switches back on only that
+	struct dormant_actor
+	{
+		TWeakObjectPtr<AActor> actor;
+		bool actor_ticked = false;
+		TArray<TWeakObjectPtr<UActorComponent>> ticking_components;
+		TArray<TWeakObjectPtr<UPrimitiveComponent>> visible_primitives;
+		TArray<TWeakObjectPtr<UAudioComponent>> playing_audio;
+	};
+
+	struct room
+	{
+		TWeakObjectPtr<APanicRoomVolume> volume;
+		FBox bounds = FBox(ForceInit);
+		TArray<TWeakObjectPtr<AActor>> actors;
+		//Index into portals of each opening out of the room
+		TArray<int32> portals;
+		bool awake = true;
+		//Seconds the room has been out of view while still awake
+		float out_of_view_time = 0.0f;
+		//Filled while the room is dormant
+		TArray<dormant_actor> dormant_actors;
+	};
+
+	struct portal
+	{
+		TWeakObjectPtr<APanicPortalVolume> volume;
+		FBox bounds = FBox(ForceInit);
+		int32 room_a = INDEX_NONE;
+		int32 room_b = INDEX_NONE;
+		float wake_distance = 0.0f;
+	};
+
+	//Finds each room's actors and joins rooms through their portals. Wakes everything first.
+	void rebuild();
+
+	//Room containing the point, trying the last room the player was in first
+	int32 roomAt(const FVector& location) const;
+
+	//Room the actor fits entirely inside, trying current_room first, or INDEX_NONE
+	int32 roomFor(const AActor* actor, int32 current_room) const;
+
+	//Moves movable actors that changed room, putting them to sleep or waking them to match their new room
+	void placeMovableActors();
+
+	int32 roomIndexOf(const APanicRoomVolume* volume) const;
+
+	//True if the opening's bounding sphere reaches into the view cone
+	static bool isPortalInView(const portal& opening, const FVector& eye, const FVector& forward, float half_angle);
+
+	void sleepRoom(room& sleeping);
+
+	void wakeRoom(room& waking);
+
+	void sleepActor(AActor* actor, TArray<dormant_actor>& dormant_actors);
+
+	static void wakeActor(const dormant_actor& state);
+
+	void onLevelChanged(ULevel* level, UWorld* world);
+
+	TArray<TWeakObjectPtr<APanicRoomVolume>> room_volumes;
+
+	TArray<TWeakObjectPtr<APanicPortalVolume>> portal_volumes;
+
+	TArray<room> rooms;
+
+	TArray<portal> portals;
+
+	//Room of each assigned actor
+	TMap<TWeakObjectPtr<const AActor>, int32> actor_rooms;
+
+	//Actors with a movable root, placed in a room again on every update
+	TArray<TWeakObjectPtr<AActor>> movable_actors;
+
+	int32 player_room = INDEX_NONE;
+
+	//Seconds since the awake set was last worked out
+	float time_since_update = 0.0f;
+
+	bool dirty = true;
+
+	FDelegateHandle level_added_handle;
+	FDelegateHandle level_removed_handle;
+};
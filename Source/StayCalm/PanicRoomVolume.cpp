@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicRoomVolume.h"
+#include "PanicRoomSubsystem.h"
+#include "Components/BrushComponent.h"
+#include "Engine/CollisionProfile.h"
+
+APanicRoomVolume::APanicRoomVolume()
+{
+	//Only used for containment tests, never for collision
+	GetBrushComponent()->SetCollisionProfileName(UCollisionProfile::NoCollision_ProfileName);
+	GetBrushComponent()->SetGenerateOverlapEvents(false);
+}
+
+void APanicRoomVolume::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (UPanicRoomSubsystem* rooms = GetWorld()->GetSubsystem<UPanicRoomSubsystem>())
+	{
+		rooms->registerRoom(this);
+	}
+}
+
+void APanicRoomVolume::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UPanicRoomSubsystem* rooms = GetWorld()->GetSubsystem<UPanicRoomSubsystem>())
+	{
+		rooms->unregisterRoom(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+APanicPortalVolume::APanicPortalVolume()
+{
+	GetBrushComponent()->SetCollisionProfileName(UCollisionProfile::NoCollision_ProfileName);
+	GetBrushComponent()->SetGenerateOverlapEvents(false);
+}
+
+void APanicPortalVolume::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (UPanicRoomSubsystem* rooms = GetWorld()->GetSubsystem<UPanicRoomSubsystem>())
+	{
+		rooms->registerPortal(this);
+	}
+}
+
+void APanicPortalVolume::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UPanicRoomSubsystem* rooms = GetWorld()->GetSubsystem<UPanicRoomSubsystem>())
+	{
+		rooms->unregisterPortal(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Volume.h"
+#include "PanicRoomVolume.generated.h"
+
+/**
+ * One room of an interior level. Actors that fit entirely inside the room go dormant while the player cannot see into
+ * it. Rooms are joined by APanicPortalVolume doorways.
+ */
+UCLASS()
+class STAYCALM_API APanicRoomVolume : public AVolume
+{
+	GENERATED_BODY()
+
+public:
+	APanicRoomVolume();
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+};
+
+/**
+ * Doorway, window or other opening between two rooms. The room on the far side wakes when the player comes within
+ * wake_distance of the opening.
+ */
+UCLASS()
+class STAYCALM_API APanicPortalVolume : public AVolume
+{
+	GENERATED_BODY()
+
+public:
+	APanicPortalVolume();
+
+	//The rooms either side. Rooms left empty are found from the rooms the opening overlaps.
+	UPROPERTY(EditInstanceOnly, BlueprintReadOnly, Category = Rooms)
+		APanicRoomVolume* room_a;
+
+	UPROPERTY(EditInstanceOnly, BlueprintReadOnly, Category = Rooms)
+		APanicRoomVolume* room_b;
+
+	//Distance in cm from the opening at which the room on the other side wakes
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Rooms, meta = (ClampMin = "0.0"))
+		float wake_distance = 1500.0f;
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+};
@@ -0,0 +1,242 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicScalability.h"
+#include "StayCalm.h"
+
+DECLARE_CYCLE_STAT(TEXT("Panic Scalability"), STAT_PanicScalability, STATGROUP_StayCalm);
+
+namespace
+{
+	//Screen percentage is written in steps of this many points so render targets are not resized every frame
+	constexpr float screen_percentage_step = 5.0f;
+}
+
+void FPanicScalabilityPolicy::configure(const FPanicScalabilitySettings& in_settings)
+{
+	settings = in_settings;
+	settings.low_blur = FMath::Max(settings.low_blur, settings.reduced_blur);
+	settings.low_screen_percentage = FMath::Min(settings.low_screen_percentage, settings.reduced_screen_percentage);
+	reset();
+}
+
+void FPanicScalabilityPolicy::reset()
+{
+	current_tier = full;
+	pending_tier = full;
+	pending_time = 0.0f;
+	screen_percentage = 100.0f;
+	tier_changes = 0;
+}
+
+int32 FPanicScalabilityPolicy::desiredTier(float blur) const
+{
+	if (!settings.enabled)
+	{
+		return full;
+	}
+
+	//Going down a tier needs blur past the threshold, coming back up needs it hysteresis below
+	const float low_threshold = current_tier >= low ? settings.low_blur - settings.hysteresis : settings.low_blur;
+	const float reduced_threshold = current_tier >= reduced ? settings.reduced_blur - settings.hysteresis : settings.reduced_blur;
+
+	if (blur >= low_threshold)
+	{
+		return low;
+	}
+	if (blur >= reduced_threshold)
+	{
+		return reduced;
+	}
+	return full;
+}
+
+float FPanicScalabilityPolicy::targetScreenPercentage() const
+{
+	switch (current_tier)
+	{
+	case low:
+		return settings.low_screen_percentage;
+	case reduced:
+		return settings.reduced_screen_percentage;
+	default:
+		return 100.0f;
+	}
+}
+
+bool FPanicScalabilityPolicy::update(float blur, float delta_time)
+{
+	bool changed = false;
+
+	const int32 desired_tier = desiredTier(blur);
+	if (desired_tier == current_tier)
+	{
+		pending_tier = current_tier;
+		pending_time = 0.0f;
+	}
+	else
+	{
+		//The hold restarts whenever blur asks for a different tier
+		if (desired_tier != pending_tier)
+		{
+			pending_tier = desired_tier;
+			pending_time = 0.0f;
+		}
+
+		pending_time += delta_time;
+		if (pending_time >= settings.hold_time)
+		{
+			current_tier = pending_tier;
+			pending_time = 0.0f;
+			tier_changes++;
+			changed = true;
+		}
+	}
+
+	const float target = targetScreenPercentage();
+	const float rate = target < screen_percentage ? settings.lower_rate : settings.restore_rate;
+	screen_percentage = FMath::FInterpConstantTo(screen_percentage, target, delta_time, rate);
+
+	return changed;
+}
+
+void FPanicScalabilityController::configure(const FPanicScalabilitySettings& in_settings)
+{
+	restore();
+
+	settings = in_settings;
+	policy.configure(settings);
+
+	IConsoleManager& console = IConsoleManager::Get();
+	screen_percentage.variable = console.FindConsoleVariable(TEXT("r.ScreenPercentage"));
+	shadow_quality.variable = console.FindConsoleVariable(TEXT("r.ShadowQuality"));
+	bloom_quality.variable = console.FindConsoleVariable(TEXT("r.BloomQuality"));
+	ambient_occlusion_levels.variable = console.FindConsoleVariable(TEXT("r.AmbientOcclusionLevels"));
+}
+
+void FPanicScalabilityController::update(float blur, float delta_time)
+{
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_PanicScalability);
+
+	const bool tier_changed = policy.update(blur, delta_time);
+
+	//Nothing to do while calm at full quality
+	if (policy.getTier() == FPanicScalabilityPolicy::full && policy.getScreenPercentage() >= 100.0f && !isLowered())
+	{
+		return;
+	}
+
+	if (tier_changed)
+	{
+		UE_LOG(LogStayCalm, Verbose, TEXT("Panic scalability tier %d at blur %.2f"), policy.getTier(), blur);
+		applyTier(policy.getTier());
+	}
+
+	if (screen_percentage.variable != nullptr)
+	{
+		//The policy works in percent of full resolution, scaled here by what the player had set
+		refreshVariable(screen_percentage);
+		const float target = policy.getScreenPercentage() >= 100.0f ? screen_percentage.original
+			: FMath::GridSnap(screen_percentage.original * policy.getScreenPercentage() / 100.0f, screen_percentage_step);
+		lowerVariable(screen_percentage, target);
+	}
+}
+
+void FPanicScalabilityController::applyTier(int32 tier)
+{
+	const bool is_low = tier == FPanicScalabilityPolicy::low;
+	const float shadow_target = is_low ? settings.low_shadow_quality : settings.reduced_shadow_quality;
+	const float post_process_target = is_low ? settings.low_post_process_quality : settings.reduced_post_process_quality;
+
+	for (scaled_variable* scaled : { &shadow_quality, &bloom_quality, &ambient_occlusion_levels })
+	{
+		if (tier == FPanicScalabilityPolicy::full)
+		{
+			restoreVariable(*scaled);
+		}
+		else
+		{
+			lowerVariable(*scaled, scaled == &shadow_quality ? shadow_target : post_process_target);
+		}
+	}
+}
+
+void FPanicScalabilityController::refreshVariable(scaled_variable& scaled)
+{
+	if (scaled.lowered && scaled.variable->GetFloat() == scaled.written)
+	{
+		return;
+	}
+
+	scaled.original = scaled.variable->GetFloat();
+	scaled.priority = (EConsoleVariableFlags)(scaled.variable->GetFlags() & ECVF_SetByMask);
+	scaled.lowered = false;
+}
+
+void FPanicScalabilityController::lowerVariable(scaled_variable& scaled, float target)
+{
+	if (scaled.variable == nullptr)
+	{
+		return;
+	}
+
+	refreshVariable(scaled);
+
+	//Set from the console, e.g. while profiling. Writing at that priority would override it.
+	if (scaled.priority > ECVF_SetByCode)
+	{
+		return;
+	}
+
+	//Never raise anything above the player's own setting
+	const float value = FMath::Min(target, scaled.original);
+	if (value >= scaled.original)
+	{
+		restoreVariable(scaled);
+		return;
+	}
+
+	if (!scaled.lowered || value != scaled.written)
+	{
+		if (scaled.variable->IsVariableInt())
+		{
+			scaled.variable->Set(FMath::RoundToInt(value), scaled.priority);
+		}
+		else
+		{
+			scaled.variable->Set(value, scaled.priority);
+		}
+		scaled.written = scaled.variable->GetFloat();
+		scaled.lowered = true;
+	}
+}
+
+void FPanicScalabilityController::restoreVariable(scaled_variable& scaled)
+{
+	if (scaled.variable != nullptr && scaled.lowered && scaled.variable->GetFloat() == scaled.written)
+	{
+		if (scaled.variable->IsVariableInt())
+		{
+			scaled.variable->Set(FMath::RoundToInt(scaled.original), scaled.priority);
+		}
+		else
+		{
+			scaled.variable->Set(scaled.original, scaled.priority);
+		}
+	}
+	scaled.lowered = false;
+}
+
+bool FPanicScalabilityController::isLowered() const
+{
+	return screen_percentage.lowered || shadow_quality.lowered || bloom_quality.lowered || ambient_occlusion_levels.lowered;
+}
+
+void FPanicScalabilityController::restore()
+{
+	for (scaled_variable* scaled : { &screen_percentage, &shadow_quality, &bloom_quality, &ambient_occlusion_levels })
+	{
+		restoreVariable(*scaled);
+	}
+	policy.reset();
+}
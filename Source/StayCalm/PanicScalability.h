@@ -0,0 +1,169 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "PanicScalability.generated.h"
+
+/**
+ * When rendering quality is lowered during panic blur, and by how much
+ */
+USTRUCT(BlueprintType)
+struct STAYCALM_API FPanicScalabilitySettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic)
+	bool enabled = true;
+
+	//Blur strength, 0 to 1, at which quality drops to reduced and to low
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float reduced_blur = 0.6f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float low_blur = 0.95f;
+
+	//How far blur must fall below a threshold before quality goes back up, so quality does not flap around it
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float hysteresis = 0.2f;
+
+	//Seconds blur must stay past a threshold before the quality tier changes
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0"))
+	float hold_time = 0.5f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "50.0", ClampMax = "100.0"))
+	float reduced_screen_percentage = 85.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "50.0", ClampMax = "100.0"))
+	float low_screen_percentage = 70.0f;
+
+	//Screen percentage points per second when quality is lowered and when it is restored
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1.0"))
+	float lower_rate = 60.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1.0"))
+	float restore_rate = 15.0f;
+
+	//r.ShadowQuality at the reduced and low tiers. Never raised above the player's setting.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0", ClampMax = "5"))
+	int32 reduced_shadow_quality = 3;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0", ClampMax = "5"))
+	int32 low_shadow_quality = 2;
+
+	//r.BloomQuality and r.AmbientOcclusionLevels at the reduced and low tiers. Never raised above the player's setting.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0", ClampMax = "5"))
+	int32 reduced_post_process_quality = 3;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0", ClampMax = "5"))
+	int32 low_post_process_quality = 1;
+};
+
+/**
+ * Decides the rendering quality tier from the panic blur strength. Has no engine dependencies so it can be run headless
+ * against recorded panic curves.
+ * Tier 0 is full quality, 1 is reduced and 2 is low. Quality drops when blur has been past a tier's threshold for
+ * hold_time, and only comes back once blur has been hysteresis below it for as long. Screen percentage moves towards the
+ * tier's target at a limited rate, quickly down and slowly back up.
+ */
+class STAYCALM_API FPanicScalabilityPolicy
+{
+public:
+	enum tier : int32
+	{
+		full,
+		reduced,
+		low
+	};
+
+	void configure(const FPanicScalabilitySettings& in_settings);
+
+	void reset();
+
+	/**
+	* @param blur - panic blur strength, 0 to 1
+	* @return True if the tier changed
+	**/
+	bool update(float blur, float delta_time);
+
+	inline int32 getTier() const { return current_tier; }
+
+	inline float getScreenPercentage() const { return screen_percentage; }
+
+	//Number of tier changes since the last reset
+	inline int32 getTierChanges() const { return tier_changes; }
+
+private:
+	//Tier that the blur asks for now, before the hold time
+	int32 desiredTier(float blur) const;
+
+	float targetScreenPercentage() const;
+
+	FPanicScalabilitySettings settings;
+
+	int32 current_tier = full;
+
+	//Tier the blur has been asking for, and for how long
+	int32 pending_tier = full;
+	float pending_time = 0.0f;
+
+	float screen_percentage = 100.0f;
+
+	int32 tier_changes = 0;
+};
+
+/**
+ * Applies FPanicScalabilityPolicy to the renderer through console variables, and puts the player's settings back when
+ * panic falls or play ends. Each variable is written at the priority its value already had, so settings menu changes
+ * made later still apply. Variables set from the console are left alone.
+ */
+class STAYCALM_API FPanicScalabilityController
+{
+public:
+	void configure(const FPanicScalabilitySettings& in_settings);
+
+	//Called every frame with the current panic blur strength
+	void update(float blur, float delta_time);
+
+	//Puts back the settings that were in use before panic lowered them
+	void restore();
+
+	inline const FPanicScalabilityPolicy& getPolicy() const { return policy; }
+
+private:
+	struct scaled_variable
+	{
+		IConsoleVariable* variable = nullptr;
+		//The player's value and the priority it was set with
+		float original = 0.0f;
+		EConsoleVariableFlags priority = ECVF_SetByConstructor;
+		//Value last written, to notice the player changing the setting while it is lowered
+		float written = 0.0f;
+		bool lowered = false;
+	};
+
+	//Takes the variable's current value as the player's setting unless it still holds what panic wrote
+	static void refreshVariable(scaled_variable& scaled);
+
+	//Lowers the variable to target, or puts it back if target is not below the player's setting
+	static void lowerVariable(scaled_variable& scaled, float target);
+
+	//Puts back the player's setting unless they changed it while it was lowered
+	static void restoreVariable(scaled_variable& scaled);
+
+	void applyTier(int32 tier);
+
+	bool isLowered() const;
+
+	FPanicScalabilitySettings settings;
+
+	FPanicScalabilityPolicy policy;
+
+	//Written in whole steps so render targets are not resized every frame
+	scaled_variable screen_percentage;
+
+	scaled_variable shadow_quality;
+	scaled_variable bloom_quality;
+	scaled_variable ambient_occlusion_levels;
+};
@@ -0,0 +1,237 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicSession.h"
+
+const FName PanicSessionAxis::names[PanicSessionAxis::Count] =
+{
+	TEXT("MoveForward"),
+	TEXT("MoveRight"),
+	TEXT("Turn"),
+	TEXT("LookUp"),
+	TEXT("TurnRate"),
+	TEXT("LookUpRate"),
+};
+
+namespace
+{
+	constexpr float location_scale = 10.0f;
+	constexpr float axis_scale = 1024.0f;
+	constexpr float delta_time_scale = 1000000.0f;
+
+	void writeVarint(uint32 value, TArray<uint8>& out_bytes)
+	{
+		while (value >= 0x80)
+		{
+			out_bytes.Add((uint8)(value | 0x80));
+			value >>= 7;
+		}
+		out_bytes.Add((uint8)value);
+	}
+
+	//Small negative numbers become small unsigned numbers, so they stay short as varints
+	uint32 zigzag(int32 value)
+	{
+		return ((uint32)value << 1) ^ (uint32)(value >> 31);
+	}
+
+	int32 unzigzag(uint32 value)
+	{
+		return (int32)(value >> 1) ^ -(int32)(value & 1);
+	}
+
+	void quantize(const FPanicSessionFrame& frame, int32 (&out_fields)[PanicSessionFormat::field_count])
+	{
+		using namespace PanicSessionFormat;
+
+		out_fields[delta_time] = FMath::RoundToInt(frame.delta_time * delta_time_scale);
+		out_fields[location_x] = FMath::RoundToInt(frame.camera_location.X * location_scale);
+		out_fields[location_y] = FMath::RoundToInt(frame.camera_location.Y * location_scale);
+		out_fields[location_z] = FMath::RoundToInt(frame.camera_location.Z * location_scale);
+		out_fields[pitch] = FRotator::CompressAxisToShort(frame.camera_rotation.Pitch);
+		out_fields[yaw] = FRotator::CompressAxisToShort(frame.camera_rotation.Yaw);
+		out_fields[roll] = FRotator::CompressAxisToShort(frame.camera_rotation.Roll);
+		for (int32 axis = 0; axis < PanicSessionAxis::Count; axis++)
+		{
+			out_fields[first_axis + axis] = FMath::RoundToInt(frame.axes[axis] * axis_scale);
+		}
+		out_fields[panic_level] = frame.panic_level;
+	}
+
+	void dequantize(const int32 (&fields)[PanicSessionFormat::field_count], FPanicSessionFrame& out_frame)
+	{
+		using namespace PanicSessionFormat;
+
+		out_frame.delta_time = fields[delta_time] / delta_time_scale;
+		out_frame.camera_location = FVector(fields[location_x], fields[location_y], fields[location_z]) / location_scale;
+		out_frame.camera_rotation = FRotator(
+			FRotator::DecompressAxisFromShort((uint16)fields[pitch]),
+			FRotator::DecompressAxisFromShort((uint16)fields[yaw]),
+			FRotator::DecompressAxisFromShort((uint16)fields[roll]));
+		for (int32 axis = 0; axis < PanicSessionAxis::Count; axis++)
+		{
+			out_frame.axes[axis] = fields[first_axis + axis] / axis_scale;
+		}
+		out_frame.panic_level = fields[panic_level];
+	}
+
+	bool isRotationField(int32 field)
+	{
+		return field == PanicSessionFormat::pitch || field == PanicSessionFormat::yaw || field == PanicSessionFormat::roll;
+	}
+}
+
+void FPanicSessionEncoder::writeHeader(const FString& map_name, TArray<uint8>& out_bytes)
+{
+	FMemory::Memzero(previous);
+
+	writeVarint(PanicSessionFormat::magic, out_bytes);
+	writeVarint(PanicSessionFormat::version, out_bytes);
+
+	const FTCHARToUTF8 map_name_utf8(*map_name);
+	writeVarint(map_name_utf8.Length(), out_bytes);
+	out_bytes.Append((const uint8*)map_name_utf8.Get(), map_name_utf8.Length());
+}
+
+void FPanicSessionEncoder::writeFrame(const FPanicSessionFrame& frame, TArray<uint8>& out_bytes)
+{
+	int32 fields[PanicSessionFormat::field_count];
+	quantize(frame, fields);
+
+	int32 deltas[PanicSessionFormat::field_count];
+	uint32 changed = 0;
+	for (int32 field = 0; field < PanicSessionFormat::field_count; field++)
+	{
+		deltas[field] = fields[field] - previous[field];
+
+		//Rotations wrap, so the shortest way round is stored
+		if (isRotationField(field))
+		{
+			deltas[field] = (int16)deltas[field];
+		}
+
+		if (deltas[field] != 0)
+		{
+			changed |= 1u << field;
+		}
+		previous[field] = fields[field];
+	}
+
+	if (frame.activated_triggers.Num() > 0)
+	{
+		changed |= PanicSessionFormat::triggers_bit;
+	}
+
+	writeVarint(changed, out_bytes);
+	for (int32 field = 0; field < PanicSessionFormat::field_count; field++)
+	{
+		if (changed & (1u << field))
+		{
+			writeVarint(zigzag(deltas[field]), out_bytes);
+		}
+	}
+
+	if (changed & PanicSessionFormat::triggers_bit)
+	{
+		writeVarint(frame.activated_triggers.Num(), out_bytes);
+		for (int32 level : frame.activated_triggers)
+		{
+			writeVarint(zigzag(level), out_bytes);
+		}
+	}
+}
+
+FPanicSessionDecoder::FPanicSessionDecoder(const TArray<uint8>& in_bytes)
+	: bytes(in_bytes)
+{
+}
+
+bool FPanicSessionDecoder::readVarint(uint32& out_value)
+{
+	out_value = 0;
+	for (int32 shift = 0; shift < 35; shift += 7)
+	{
+		if (offset >= bytes.Num())
+		{
+			return false;
+		}
+
+		const uint8 byte = bytes[offset++];
+		out_value |= (uint32)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FPanicSessionDecoder::readHeader(FString& out_map_name)
+{
+	offset = 0;
+	FMemory::Memzero(previous);
+
+	uint32 file_magic = 0;
+	uint32 file_version = 0;
+	uint32 name_length = 0;
+	if (!readVarint(file_magic) || file_magic != PanicSessionFormat::magic
+		|| !readVarint(file_version) || file_version != PanicSessionFormat::version
+		|| !readVarint(name_length) || offset + (int32)name_length > bytes.Num())
+	{
+		return false;
+	}
+
+	out_map_name = FString(FUTF8ToTCHAR((const ANSICHAR*)bytes.GetData() + offset, name_length));
+	offset += name_length;
+	return true;
+}
+
+bool FPanicSessionDecoder::readFrame(FPanicSessionFrame& out_frame)
+{
+	uint32 changed = 0;
+	if (!readVarint(changed))
+	{
+		return false;
+	}
+
+	for (int32 field = 0; field < PanicSessionFormat::field_count; field++)
+	{
+		if (changed & (1u << field))
+		{
+			uint32 delta = 0;
+			if (!readVarint(delta))
+			{
+				return false;
+			}
+			previous[field] += unzigzag(delta);
+
+			if (isRotationField(field))
+			{
+				previous[field] &= 0xFFFF;
+			}
+		}
+	}
+
+	dequantize(previous, out_frame);
+
+	out_frame.activated_triggers.Reset();
+	if (changed & PanicSessionFormat::triggers_bit)
+	{
+		uint32 count = 0;
+		if (!readVarint(count))
+		{
+			return false;
+		}
+
+		for (uint32 index = 0; index < count; index++)
+		{
+			uint32 level = 0;
+			if (!readVarint(level))
+			{
+				return false;
+			}
+			out_frame.activated_triggers.Add(unzigzag(level));
+		}
+	}
+	return true;
+}
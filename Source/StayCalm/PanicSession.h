@@ -0,0 +1,117 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Input axes captured in a session, in the order they are stored
+namespace PanicSessionAxis
+{
+	enum Type : uint8
+	{
+		MoveForward,
+		MoveRight,
+		Turn,
+		LookUp,
+		TurnRate,
+		LookUpRate,
+		Count
+	};
+
+	//Axis mapping names from DefaultInput.ini, indexed by Type
+	extern STAYCALM_API const FName names[Count];
+}
+
+/**
+ * Everything recorded about one frame of a play session
+ */
+struct STAYCALM_API FPanicSessionFrame
+{
+	float delta_time = 0.0f;
+
+	FVector camera_location = FVector::ZeroVector;
+
+	FRotator camera_rotation = FRotator::ZeroRotator;
+
+	//Sum of the values each axis binding received this frame
+	float axes[PanicSessionAxis::Count] = {};
+
+	int32 panic_level = 0;
+
+	//Panic level of each trigger activated this frame
+	TArray<int32, TInlineAllocator<2>> activated_triggers;
+};
+
+/**
+ * Session file layout:
+ *   header: magic, version, map name
+ *   frames: a varint bit mask of the fields that changed, then a zigzag varint delta for each of them
+ * Values are quantized before the delta is taken, so decoding reproduces the quantized values exactly and never drifts.
+ * Frame time is kept in microseconds, location in millimetres, rotation in 1/65536 turns and axes in 1/1024 units.
+ */
+namespace PanicSessionFormat
+{
+	constexpr uint32 magic = 0x53524353;
+
+	constexpr uint16 version = 1;
+
+	//Quantized frame fields, in the order of their bit in the change mask
+	enum field : uint8
+	{
+		delta_time,
+		location_x,
+		location_y,
+		location_z,
+		pitch,
+		yaw,
+		roll,
+		first_axis,
+		panic_level = first_axis + PanicSessionAxis::Count,
+		field_count
+	};
+
+	//Set in the change mask when trigger activations follow the field deltas
+	constexpr uint32 triggers_bit = 1u << field_count;
+
+	static_assert(field_count < 31, "The change mask must fit in 32 bits");
+}
+
+/**
+ * Turns frames into the compact session format
+ */
+class STAYCALM_API FPanicSessionEncoder
+{
+public:
+	//Appends the file header to out_bytes and resets the delta state
+	void writeHeader(const FString& map_name, TArray<uint8>& out_bytes);
+
+	//Appends one frame to out_bytes
+	void writeFrame(const FPanicSessionFrame& frame, TArray<uint8>& out_bytes);
+
+private:
+	int32 previous[PanicSessionFormat::field_count] = {};
+};
+
+/**
+ * Reads frames back out of a session file in memory
+ */
+class STAYCALM_API FPanicSessionDecoder
+{
+public:
+	explicit FPanicSessionDecoder(const TArray<uint8>& in_bytes);
+
+	//Reads the header. Returns false if the bytes are not a session of a supported version.
+	bool readHeader(FString& out_map_name);
+
+	//Reads the next frame. Returns false at the end of the data or if it is damaged.
+	bool readFrame(FPanicSessionFrame& out_frame);
+
+private:
+	bool readVarint(uint32& out_value);
+
+	const TArray<uint8>& bytes;
+
+	int32 offset = 0;
+
+	int32 previous[PanicSessionFormat::field_count] = {};
+};
@@ -0,0 +1,188 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicSessionRecorder.h"
+#include "StayCalm.h"
+#include "StayCalmCharacter.h"
+#include "Containers/Queue.h"
+#include "HAL/FileManager.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/DateTime.h"
+#include "Misc/Paths.h"
+
+DECLARE_CYCLE_STAT(TEXT("Record Session Frame"), STAT_RecordSessionFrame, STATGROUP_StayCalm);
+
+/**
+ * Background thread that writes session chunks to disk. The game thread is the only producer, so a single producer
+ * single consumer queue is enough and neither side takes a lock.
+ */
+class FPanicSessionWriter : public FRunnable
+{
+public:
+	explicit FPanicSessionWriter(IFileHandle* in_file)
+		: file(in_file)
+		, wake(FPlatformProcess::GetSynchEventFromPool())
+	{
+		thread = FRunnableThread::Create(this, TEXT("PanicSessionWriter"), 0, TPri_BelowNormal);
+	}
+
+	virtual ~FPanicSessionWriter()
+	{
+		//Stop is called by Kill, and the thread drains the queue before it returns
+		if (thread != nullptr)
+		{
+			thread->Kill(true);
+			delete thread;
+		}
+		FPlatformProcess::ReturnSynchEventToPool(wake);
+	}
+
+	//Called on the game thread
+	void enqueue(TArray<uint8>&& bytes)
+	{
+		chunks.Enqueue(MoveTemp(bytes));
+		wake->Trigger();
+	}
+
+	virtual uint32 Run() override
+	{
+		while (!stopping)
+		{
+			wake->Wait(100);
+			drain();
+		}
+		drain();
+		file->Flush();
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		stopping = true;
+		wake->Trigger();
+	}
+
+private:
+	void drain()
+	{
+		TArray<uint8> bytes;
+		while (chunks.Dequeue(bytes))
+		{
+			file->Write(bytes.GetData(), bytes.Num());
+		}
+	}
+
+	TUniquePtr<IFileHandle> file;
+
+	TQueue<TArray<uint8>, EQueueMode::Spsc> chunks;
+
+	FEvent* wake;
+
+	FRunnableThread* thread = nullptr;
+
+	TAtomic<bool> stopping { false };
+};
+
+UPanicSessionRecorder::UPanicSessionRecorder()
+{
+	//Last, so the frame sees this frame's camera and panic state
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+	PrimaryComponentTick.TickGroup = TG_PostUpdateWork;
+}
+
+//The writer is only a complete type here
+UPanicSessionRecorder::~UPanicSessionRecorder() = default;
+
+void UPanicSessionRecorder::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (FParse::Param(FCommandLine::Get(), TEXT("StayCalmRecord")))
+	{
+		startRecording(FString());
+	}
+}
+
+void UPanicSessionRecorder::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	stopRecording();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UPanicSessionRecorder::startRecording(const FString& file_name)
+{
+	stopRecording();
+
+	const FString name = file_name.IsEmpty() ? FString::Printf(TEXT("Session-%s.scsession"), *FDateTime::Now().ToString()) : file_name;
+	const FString path = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Sessions"), name);
+
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(path), true);
+	IFileHandle* file = IPlatformFile::GetPlatformPhysical().OpenWrite(*path);
+	if (file == nullptr)
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("Could not open %s to record the session"), *path);
+		return;
+	}
+
+	LLM_SCOPE_BYTAG(StayCalm);
+	writer = MakeUnique<FPanicSessionWriter>(file);
+	chunk.Reset(chunk_size);
+	frame = FPanicSessionFrame();
+	encoder.writeHeader(GetWorld()->GetMapName(), chunk);
+
+	SetComponentTickEnabled(true);
+	UE_LOG(LogStayCalm, Log, TEXT("Recording session to %s"), *path);
+}
+
+void UPanicSessionRecorder::stopRecording()
+{
+	if (!isRecording())
+	{
+		return;
+	}
+
+	flushChunk();
+	writer.Reset();
+	SetComponentTickEnabled(false);
+}
+
+void UPanicSessionRecorder::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (!isRecording())
+	{
+		return;
+	}
+
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_RecordSessionFrame);
+
+	frame.delta_time = DeltaTime;
+	GetOwner()->GetActorEyesViewPoint(frame.camera_location, frame.camera_rotation);
+	if (const AStayCalmCharacter* character = Cast<AStayCalmCharacter>(GetOwner()))
+	{
+		frame.panic_level = character->getPanicLevel();
+	}
+
+	encoder.writeFrame(frame, chunk);
+
+	FMemory::Memzero(frame.axes);
+	frame.activated_triggers.Reset();
+
+	if (chunk.Num() >= chunk_size)
+	{
+		flushChunk();
+	}
+}
+
+void UPanicSessionRecorder::flushChunk()
+{
+	if (writer.IsValid() && chunk.Num() > 0)
+	{
+		writer->enqueue(MoveTemp(chunk));
+		chunk.Reset(chunk_size);
+	}
+}
@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "PanicSession.h"
+#include "PanicSessionRecorder.generated.h"
+
+class FPanicSessionWriter;
+
+/**
+ * Records the owning character's play session to a compact binary file: camera transform, axis input, panic level,
+ * trigger activations and frame time, once per frame. Frames are encoded on the game thread into chunks, and chunks
+ * are handed to a background thread through a lock-free queue to be written, so recording never waits on the disk.
+ * Sessions are replayed headless with -run=StayCalmSimulation -Replay=<file>.
+ * Starts on its own when the game is run with -StayCalmRecord.
+ */
+UCLASS(ClassGroup = (Panic), meta = (BlueprintSpawnableComponent))
+class STAYCALM_API UPanicSessionRecorder : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UPanicSessionRecorder();
+
+	virtual ~UPanicSessionRecorder();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	/**
+	* Starts writing a new session, ending any session already being recorded.
+	* @param file_name - file under Saved/Sessions. A name is made from the date when empty.
+	**/
+	UFUNCTION(BlueprintCallable, Category = Panic)
+	void startRecording(const FString& file_name);
+
+	//Writes out everything recorded so far and closes the file
+	UFUNCTION(BlueprintCallable, Category = Panic)
+	void stopRecording();
+
+	UFUNCTION(BlueprintCallable, Category = Panic)
+	bool isRecording() const { return writer.IsValid(); }
+
+	//Adds to the value recorded for an axis this frame. Called by the owner's input bindings.
+	inline void recordAxis(PanicSessionAxis::Type axis, float value)
+	{
+		if (isRecording())
+		{
+			frame.axes[axis] += value;
+		}
+	}
+
+	//Records that a trigger of the given panic level was activated this frame
+	inline void recordTriggerActivated(int32 panic_level)
+	{
+		if (isRecording())
+		{
+			frame.activated_triggers.Add(panic_level);
+		}
+	}
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	//Encoded frames waiting to be handed to the writer. Handed over once they reach this size.
+	static constexpr int32 chunk_size = 16 * 1024;
+
+	void flushChunk();
+
+	FPanicSessionFrame frame;
+
+	FPanicSessionEncoder encoder;
+
+	TArray<uint8> chunk;
+
+	TUniquePtr<FPanicSessionWriter> writer;
+};
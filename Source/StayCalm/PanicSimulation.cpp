@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicSimulation.h"
+
+void FPanicSimulation::configure(const FPanicSimulationSettings& in_settings, int32 max_level)
+{
+	settings = in_settings;
+	max_intensity = (float)FMath::Max(max_level, 1);
+	fixed_step = 1.0f / FMath::Max(settings.steps_per_second, 1);
+	heart_rate_blend = 1.0f - FMath::Exp(-settings.heart_rate_response * fixed_step);
+	reset();
+}
+
+void FPanicSimulation::reset()
+{
+	intensity = 0.0f;
+	target = 0.0f;
+	heart_rate = settings.resting_heart_rate;
+	accumulator = 0.0f;
+}
+
+bool FPanicSimulation::advance(float delta_time)
+{
+	accumulator += FMath::Max(delta_time, 0.0f);
+
+	const float previous_intensity = intensity;
+	const float previous_heart_rate = heart_rate;
+
+	int32 steps = 0;
+	while (accumulator >= fixed_step && steps < settings.max_steps_per_frame)
+	{
+		step();
+		accumulator -= fixed_step;
+		steps++;
+	}
+
+	//After a long hitch, drop the time that could not be simulated instead of catching up over several frames
+	if (steps == settings.max_steps_per_frame)
+	{
+		accumulator = FMath::Min(accumulator, fixed_step);
+	}
+
+	return intensity != previous_intensity || heart_rate != previous_heart_rate;
+}
+
+void FPanicSimulation::step()
+{
+	if (intensity < target)
+	{
+		intensity = FMath::Min(intensity + settings.rise_rate * fixed_step, target);
+	}
+	else if (intensity > target)
+	{
+		intensity = FMath::Max(intensity - settings.decay_rate * fixed_step, target);
+	}
+
+	const float target_heart_rate = FMath::Lerp(settings.resting_heart_rate, settings.max_heart_rate, intensity / max_intensity);
+	heart_rate += (target_heart_rate - heart_rate) * heart_rate_blend;
+
+	//Settle exactly so the simulation stops reporting changes once it is at rest
+	if (FMath::Abs(target_heart_rate - heart_rate) < 0.01f)
+	{
+		heart_rate = target_heart_rate;
+	}
+}
@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PanicSimulation.generated.h"
+
+/**
+ * Tuning for the continuous panic model
+ */
+USTRUCT(BlueprintType)
+struct STAYCALM_API FPanicSimulationSettings
+{
+	GENERATED_BODY()
+
+	//Panic levels per second that intensity rises by when the target is above it
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0"))
+	float rise_rate = 2.0f;
+
+	//Panic levels per second that intensity falls by when the target is below it
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0"))
+	float decay_rate = 0.5f;
+
+	//Heart rate in beats per minute when calm
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1.0"))
+	float resting_heart_rate = 70.0f;
+
+	//Heart rate in beats per minute at the highest panic level
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1.0"))
+	float max_heart_rate = 160.0f;
+
+	//How quickly the heart rate follows intensity. Higher is faster.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0"))
+	float heart_rate_response = 1.5f;
+
+	//Simulation steps per second. The simulation runs at this rate whatever the frame rate.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1"))
+	int32 steps_per_second = 60;
+
+	//Most steps run in one frame. Time past this after a long hitch is dropped.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1"))
+	int32 max_steps_per_frame = 30;
+};
+
+/**
+ * Continuous panic intensity that approaches a target panic level, plus a heart rate that follows it.
+ * Runs on a fixed timestep accumulator, so the state after a given amount of time is the same at any frame rate.
+ * Has no engine dependencies beyond math so it can be stepped headless.
+ */
+class STAYCALM_API FPanicSimulation
+{
+public:
+	/**
+	* Sets up the simulation and resets it to calm.
+	* @param max_level - highest panic level. Intensity and heart rate are scaled against it.
+	**/
+	void configure(const FPanicSimulationSettings& in_settings, int32 max_level);
+
+	//Returns to calm straight away
+	void reset();
+
+	//Sets the panic level intensity moves towards
+	inline void setTarget(float level) { target = FMath::Clamp(level, 0.0f, max_intensity); }
+
+	/**
+	* Runs as many fixed steps as fit in the time since the last call.
+	* @return True if intensity or heart rate changed
+	**/
+	bool advance(float delta_time);
+
+	//Current panic level, between 0 and the highest level
+	inline float getIntensity() const { return intensity; }
+
+	inline float getTarget() const { return target; }
+
+	//Current heart rate in beats per minute
+	inline float getHeartRate() const { return heart_rate; }
+
+	//Heart rate relative to the resting heart rate
+	inline float getHeartRateRatio() const { return heart_rate / settings.resting_heart_rate; }
+
+private:
+	void step();
+
+	FPanicSimulationSettings settings;
+
+	float max_intensity = 1.0f;
+
+	float fixed_step = 1.0f / 60.0f;
+
+	//Fraction of the gap to the target heart rate closed each step
+	float heart_rate_blend = 0.0f;
+
+	float intensity = 0.0f;
+
+	float target = 0.0f;
+
+	float heart_rate = 0.0f;
+
+	//Time not yet simulated
+	float accumulator = 0.0f;
+};
@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PanicSymptoms.generated.h"
+
+/**
+ * Everything a panic level does to the character. Moving between levels only applies the fields that differ.
+ */
+USTRUCT(BlueprintType)
+struct STAYCALM_API FPanicSymptoms
+{
+	GENERATED_BODY()
+
+	//Panic blur level. 0 - No Blur, 3 - Max Blur
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic)
+	int32 blur_level = 0;
+
+	//Depth perception level. 0 - No change, 3 - Max distance
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic)
+	int32 depth_level = 0;
+
+	//Volume multiplier of the heartbeat. 0 stops the heartbeat.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic)
+	float heartbeat_volume = 0.0f;
+
+	//Seconds movement input is delayed by
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic)
+	float movement_time_delay = 0.0f;
+
+	//Denominator for movement and look input. 1 is full speed, 2 is half speed etc.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic)
+	float movement_speed = 1.0f;
+
+	constexpr FPanicSymptoms() = default;
+
+	constexpr FPanicSymptoms(int32 in_blur_level, int32 in_depth_level, float in_heartbeat_volume, float in_movement_time_delay, float in_movement_speed)
+		: blur_level(in_blur_level)
+		, depth_level(in_depth_level)
+		, heartbeat_volume(in_heartbeat_volume)
+		, movement_time_delay(in_movement_time_delay)
+		, movement_speed(in_movement_speed)
+	{
+	}
+
+	//Blends between two sets of symptoms. Blur and depth are levels, so they round to the nearest one.
+	static FPanicSymptoms blend(const FPanicSymptoms& from, const FPanicSymptoms& to, float alpha)
+	{
+		return FPanicSymptoms(
+			FMath::RoundToInt(FMath::Lerp((float)from.blur_level, (float)to.blur_level, alpha)),
+			FMath::RoundToInt(FMath::Lerp((float)from.depth_level, (float)to.depth_level, alpha)),
+			FMath::Lerp(from.heartbeat_volume, to.heartbeat_volume, alpha),
+			FMath::Lerp(from.movement_time_delay, to.movement_time_delay, alpha),
+			FMath::Lerp(from.movement_speed, to.movement_speed, alpha));
+	}
+};
@@ -2,17 +2,24 @@
 
 
 #include "PanicTrigger.h"
+#include "PanicTriggerSubsystem.h"
+#include "PanicTriggerInstancing.h"
+#include "StayCalm.h"
 #include "Components/SceneComponent.h"
+#include "Materials/Material.h"
 
 // Sets default values
 APanicTrigger::APanicTrigger()
 {
 
 	trigger_mesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("Trigger Mesh"));
-	on_material = CreateDefaultSubobject<UMaterial>(TEXT("On Mesh"));
-	off_material = CreateDefaultSubobject<UMaterial>(TEXT("Off Mesh"));
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	{
+		LLM_SCOPE_BYTAG(StayCalm_PanicFX);
+		on_material = CreateDefaultSubobject<UMaterial>(TEXT("On Mesh"));
+		off_material = CreateDefaultSubobject<UMaterial>(TEXT("Off Mesh"));
+	}
+ 	// Triggers do not tick. Per-frame trigger state is updated in one batch by UPanicTriggerSubsystem.
+	PrimaryActorTick.bCanEverTick = false;
 
 }
 
@@ -21,14 +28,67 @@ void APanicTrigger::BeginPlay()
 {
 	Super::BeginPlay();
 	//set_is_visible(is_visible);
-	//trigger_mesh->SetMaterial(0, on_material);
+
+	if (trigger_material != nullptr)
+	{
+		trigger_mesh->SetMaterial(0, trigger_material);
+	}
+
+	//The instance draws the trigger from here on. The mesh stays for collision and sight traces.
+	//Batching needs the custom data material, instances cannot swap materials one at a time.
+	UPanicTriggerInstancing* batcher = batch_instances && trigger_material != nullptr ? GetWorld()->GetSubsystem<UPanicTriggerInstancing>() : nullptr;
+	if (batcher != nullptr && batcher->addTrigger(this))
+	{
+		instancing = batcher;
+		trigger_mesh->SetVisibility(false);
+	}
+	applyActiveState();
+
+	if (UPanicTriggerSubsystem* registry = GetWorld()->GetSubsystem<UPanicTriggerSubsystem>())
+	{
+		registry->registerTrigger(this);
+	}
 }
 
-// Called every frame
-void APanicTrigger::Tick(float DeltaTime)
+void APanicTrigger::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	Super::Tick(DeltaTime);
+	if (UPanicTriggerSubsystem* registry = GetWorld()->GetSubsystem<UPanicTriggerSubsystem>())
+	{
+		registry->unregisterTrigger(this);
+	}
+
+	if (instancing != nullptr)
+	{
+		instancing->removeTrigger(this);
+		instancing = nullptr;
+	}
 
+	Super::EndPlay(EndPlayReason);
+}
+
+void APanicTrigger::notifyStateChanged()
+{
+	UWorld* world = GetWorld();
+	if (UPanicTriggerSubsystem* registry = world != nullptr ? world->GetSubsystem<UPanicTriggerSubsystem>() : nullptr)
+	{
+		registry->notifyTriggerStateChanged(this);
+	}
+}
+
+void APanicTrigger::applyActiveState()
+{
+	if (instancing != nullptr)
+	{
+		instancing->updateTrigger(this);
+	}
+	else if (trigger_material != nullptr)
+	{
+		trigger_mesh->SetCustomPrimitiveDataFloat(PanicTriggerMaterial::active_index, panic_trigger_active ? 1.0f : 0.0f);
+	}
+	else
+	{
+		trigger_mesh->SetMaterial(0, panic_trigger_active ? on_material : off_material);
+	}
 }
 
 
@@ -39,6 +99,7 @@ bool APanicTrigger::get_is_visible()
 
 void APanicTrigger::set_is_visible(bool visible) 
 {
+	const bool changed = is_visible != visible;
 	is_visible = visible;
 	// Hides visible components
 	SetActorHiddenInGame(!visible);
@@ -46,9 +107,14 @@ void APanicTrigger::set_is_visible(bool visible)
 	// Disables collision components
 	SetActorEnableCollision(visible);
 
-	// Stops the Actor from ticking
-	SetActorTickEnabled(visible);
-
+	if (changed)
+	{
+		if (instancing != nullptr)
+		{
+			instancing->updateTrigger(this);
+		}
+		notifyStateChanged();
+	}
 }
 
 
@@ -59,14 +125,24 @@ bool APanicTrigger::get_panic_trigger_active()
 
 
 void APanicTrigger::set_panic_trigger_active(bool active) {
+	const bool changed = panic_trigger_active != active;
 	panic_trigger_active = active;
 
-	if (panic_trigger_active)
+	if (changed)
 	{
-		trigger_mesh->SetMaterial(0,on_material);
-	}
-	else 
-	{
-		trigger_mesh->SetMaterial(0, off_material);
+		applyActiveState();
+		notifyStateChanged();
 	}
 }
+
+float APanicTrigger::get_active_time()
+{
+	UPanicTriggerSubsystem* registry = GetWorld()->GetSubsystem<UPanicTriggerSubsystem>();
+	return registry != nullptr ? registry->getActiveTime(this) : 0.0f;
+}
+
+float APanicTrigger::get_dwell_time()
+{
+	UPanicTriggerSubsystem* registry = GetWorld()->GetSubsystem<UPanicTriggerSubsystem>();
+	return registry != nullptr ? registry->getDwellTime(this) : 0.0f;
+}
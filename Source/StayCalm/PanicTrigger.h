@@ -7,6 +7,17 @@
 #include "GameFramework/Actor.h"
 #include "PanicTrigger.generated.h"
 
+class UPanicTriggerInstancing;
+
+//Custom primitive data read by the trigger material. Batched triggers carry the same values as per-instance custom data.
+namespace PanicTriggerMaterial
+{
+	//1 when the trigger is active, 0 when not
+	constexpr int32 active_index = 0;
+
+	constexpr int32 num_custom_data = 1;
+}
+
 UCLASS()
 class STAYCALM_API APanicTrigger : public AActor
 {
@@ -20,14 +31,27 @@ public:
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Category = mesh)
 		class UStaticMeshComponent* trigger_mesh;
 
-	//Material to display when the trigger is active
+	/**
+	 * Material shared by every trigger. It shows the active state from custom data index PanicTriggerMaterial::active_index,
+	 * read with a custom primitive data parameter and added to PerInstanceCustomData so it works batched or not.
+	 * Leave empty to swap between on_material and off_material instead, which also keeps the trigger out of instance batches.
+	 */
+	UPROPERTY(EditAnywhere, Category = Panic)
+		class UMaterialInterface* trigger_material;
+
+	//Material to display when the trigger is active. Only used when trigger_material is empty.
 	UPROPERTY(EditAnywhere)
 		class UMaterial* on_material;
 
-	//Material to display when the trigger is inactive
+	//Material to display when the trigger is inactive. Only used when trigger_material is empty.
 	UPROPERTY(EditAnywhere)
 		class UMaterial* off_material;
 
+	//Draw with other triggers that share the mesh and material as one instanced mesh. Only used when the mesh is not movable
+	//and trigger_material is set.
+	UPROPERTY(EditAnywhere, Category = Panic)
+		bool batch_instances = true;
+
 	//The panic level that should be caused by this object
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic);
 	int panic_level = 0;
@@ -46,6 +70,14 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void set_panic_trigger_active(bool active);
 
+	//Seconds the trigger has been visible and active. Resets when it is shown or activated again.
+	UFUNCTION(BlueprintCallable)
+	float get_active_time();
+
+	//Total seconds the character has had the trigger in sight while it was active
+	UFUNCTION(BlueprintCallable)
+	float get_dwell_time();
+
 	//Implement what should happen for each panic trigger within the blueprint. Should Return Panic Level for trigger
 	UFUNCTION(BlueprintImplementableEvent, Category = Panic)
 		void trigger_event();
@@ -55,6 +87,20 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	// Called when the trigger is destroyed or its level is streamed out
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	//Tells the world's trigger registry that visibility or active state changed
+	void notifyStateChanged();
+
+	//Shows the active state through custom primitive data, through the trigger's instance when batched, or by swapping
+	//between on_material and off_material when there is no trigger_material
+	void applyActiveState();
+
+	//Set while the trigger is drawn by an instanced mesh instead of trigger_mesh
+	UPROPERTY(Transient)
+	UPanicTriggerInstancing* instancing;
+
 	//Used to determinem if the trigger is visible in game
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic)
 	bool is_visible = false;
@@ -63,8 +109,4 @@ protected:
 	UPROPERTY(BlueprintReadWrite, VisibleAnywhere, Category = Panic)
 	bool panic_trigger_active = false;
 
-public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
 };
@@ -0,0 +1,176 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicTriggerGrid.h"
+#include "PanicTrigger.h"
+#include "StayCalm.h"
+
+DECLARE_CYCLE_STAT(TEXT("Gather Cone Candidates"), STAT_GatherConeCandidates, STATGROUP_StayCalm);
+
+FPanicTriggerGrid::FPanicTriggerGrid(float in_cell_size)
+	: cell_size(FMath::Max(in_cell_size, 1.0f))
+{
+}
+
+void FPanicTriggerGrid::rebuild(const TArray<TWeakObjectPtr<APanicTrigger>>& triggers)
+{
+	entries.Reset();
+	cells.Reset();
+
+	for (const TWeakObjectPtr<APanicTrigger>& weak_trigger : triggers)
+	{
+		APanicTrigger* trigger = weak_trigger.Get();
+
+		// Hidden or inactive triggers have no collision or cannot start panic, so they never need a trace
+		if (trigger == nullptr || !trigger->get_is_visible() || !trigger->get_panic_trigger_active())
+		{
+			continue;
+		}
+
+		const FBox bounds = trigger->GetComponentsBoundingBox(true);
+		if (!bounds.IsValid)
+		{
+			continue;
+		}
+
+		const int32 index = entries.Add({ trigger, bounds, bounds.GetCenter(), bounds.GetExtent().Size() });
+
+		const FIntVector min_cell = cellFor(bounds.Min);
+		const FIntVector max_cell = cellFor(bounds.Max);
+		for (int32 x = min_cell.X; x <= max_cell.X; x++)
+		{
+			for (int32 y = min_cell.Y; y <= max_cell.Y; y++)
+			{
+				for (int32 z = min_cell.Z; z <= max_cell.Z; z++)
+				{
+					cells.FindOrAdd(FIntVector(x, y, z)).Add(index);
+				}
+			}
+		}
+	}
+}
+
+FIntVector FPanicTriggerGrid::cellFor(const FVector& location) const
+{
+	return FIntVector(
+		FMath::FloorToInt(location.X / cell_size),
+		FMath::FloorToInt(location.Y / cell_size),
+		FMath::FloorToInt(location.Z / cell_size));
+}
+
+template<typename FunctionType>
+void FPanicTriggerGrid::forEachEntryInBox(const FBox& box, FunctionType visitor) const
+{
+	visited.Init(false, entries.Num());
+
+	const FIntVector min_cell = cellFor(box.Min);
+	const FIntVector max_cell = cellFor(box.Max);
+	for (int32 x = min_cell.X; x <= max_cell.X; x++)
+	{
+		for (int32 y = min_cell.Y; y <= max_cell.Y; y++)
+		{
+			for (int32 z = min_cell.Z; z <= max_cell.Z; z++)
+			{
+				const TArray<int32>* cell = cells.Find(FIntVector(x, y, z));
+				if (cell == nullptr)
+				{
+					continue;
+				}
+
+				for (int32 index : *cell)
+				{
+					if (visited[index])
+					{
+						continue;
+					}
+					visited[index] = true;
+
+					//Returning false from the visitor stops the search
+					if (!visitor(index))
+					{
+						return;
+					}
+				}
+			}
+		}
+	}
+}
+
+void FPanicTriggerGrid::gatherConeCandidates(const FVector& origin, const FVector& forward, float cos_half_angle, float range, TArray<int32>& out_candidates) const
+{
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_GatherConeCandidates);
+
+	out_candidates.Reset();
+	if (entries.Num() == 0)
+	{
+		return;
+	}
+
+	//Broad phase: every trigger in a cell the view range touches
+	const FBox range_box(origin - FVector(range), origin + FVector(range));
+	forEachEntryInBox(range_box, [&out_candidates](int32 index)
+	{
+		out_candidates.Add(index);
+		return true;
+	});
+
+	const VectorRegister origin_x = VectorSetFloat1(origin.X);
+	const VectorRegister origin_y = VectorSetFloat1(origin.Y);
+	const VectorRegister origin_z = VectorSetFloat1(origin.Z);
+	const VectorRegister forward_x = VectorSetFloat1(forward.X);
+	const VectorRegister forward_y = VectorSetFloat1(forward.Y);
+	const VectorRegister forward_z = VectorSetFloat1(forward.Z);
+	const VectorRegister range_v = VectorSetFloat1(range);
+	const VectorRegister cos_v = VectorSetFloat1(cos_half_angle);
+	const VectorRegister epsilon = VectorSetFloat1(KINDA_SMALL_NUMBER);
+
+	//Narrow phase: bounding sphere against the cone, four triggers at a time. Failures are compacted out in place.
+	const int32 num_gathered = out_candidates.Num();
+	int32 num_kept = 0;
+	for (int32 batch = 0; batch < num_gathered; batch += 4)
+	{
+		const int32 lanes = FMath::Min(4, num_gathered - batch);
+
+		alignas(16) float xs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		alignas(16) float ys[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		alignas(16) float zs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		alignas(16) float rs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		int32 indices[4];
+		for (int32 lane = 0; lane < lanes; lane++)
+		{
+			indices[lane] = out_candidates[batch + lane];
+			const entry& candidate = entries[indices[lane]];
+			xs[lane] = candidate.center.X;
+			ys[lane] = candidate.center.Y;
+			zs[lane] = candidate.center.Z;
+			rs[lane] = candidate.radius;
+		}
+
+		const VectorRegister dx = VectorSubtract(VectorLoadAligned(xs), origin_x);
+		const VectorRegister dy = VectorSubtract(VectorLoadAligned(ys), origin_y);
+		const VectorRegister dz = VectorSubtract(VectorLoadAligned(zs), origin_z);
+		const VectorRegister radius = VectorLoadAligned(rs);
+
+		const VectorRegister along = VectorMultiplyAdd(dx, forward_x, VectorMultiplyAdd(dy, forward_y, VectorMultiply(dz, forward_z)));
+		const VectorRegister distance_squared = VectorMultiplyAdd(dx, dx, VectorMultiplyAdd(dy, dy, VectorMultiply(dz, dz)));
+		const VectorRegister distance = VectorMultiply(distance_squared, VectorReciprocalSqrtAccurate(VectorMax(distance_squared, epsilon)));
+
+		//Within range of the nearest point of the sphere
+		const VectorRegister reach = VectorAdd(range_v, radius);
+		const VectorRegister in_range = VectorCompareGE(VectorMultiply(reach, reach), distance_squared);
+
+		//The sphere pokes into the cone. Widening by the radius keeps the test conservative.
+		const VectorRegister in_cone = VectorCompareGE(VectorAdd(along, radius), VectorMultiply(cos_v, distance));
+
+		const int32 mask = VectorMaskBits(VectorBitwiseAnd(in_range, in_cone));
+		for (int32 lane = 0; lane < lanes; lane++)
+		{
+			if (mask & (1 << lane))
+			{
+				out_candidates[num_kept++] = indices[lane];
+			}
+		}
+	}
+
+	out_candidates.SetNum(num_kept, false);
+}
@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class APanicTrigger;
+
+/**
+ * Uniform grid of the panic triggers that can currently be sensed (visible and active).
+ * The grid is only rebuilt when a trigger changes state, so the per-frame sensing check is a
+ * handful of cell lookups and a batched cone test instead of physics traces against the whole level.
+ * Queries share scratch state, so a grid is only queried from one thread at a time.
+ */
+class STAYCALM_API FPanicTriggerGrid
+{
+public:
+	FPanicTriggerGrid(float in_cell_size = 1000.0f);
+
+	/**
+	* Rebuilds the grid from the given triggers. Only triggers that are visible and active are inserted.
+	* @param triggers - every trigger known to the level. Stale entries are skipped.
+	**/
+	void rebuild(const TArray<TWeakObjectPtr<APanicTrigger>>& triggers);
+
+	/**
+	* Finds the live triggers whose bounding sphere reaches into the view cone. Nearby cells are gathered first
+	* and their trigger centers are then tested against the cone four at a time with SIMD.
+	* @param origin - apex of the cone
+	* @param forward - unit direction of the cone axis
+	* @param cos_half_angle - cosine of the widest angle from forward that can be seen
+	* @param range - furthest distance that can be seen
+	* @param out_candidates - reset and filled with indices of the triggers that passed
+	**/
+	void gatherConeCandidates(const FVector& origin, const FVector& forward, float cos_half_angle, float range, TArray<int32>& out_candidates) const;
+
+	inline APanicTrigger* triggerAt(int32 index) const { return entries[index].trigger; }
+
+	inline const FBox& boundsAt(int32 index) const { return entries[index].bounds; }
+
+	inline const FVector& centerAt(int32 index) const { return entries[index].center; }
+
+	inline float radiusAt(int32 index) const { return entries[index].radius; }
+
+	//Number of triggers that can currently be sensed
+	inline int32 num() const { return entries.Num(); }
+
+	inline bool isEmpty() const { return entries.Num() == 0; }
+
+private:
+	struct entry
+	{
+		APanicTrigger* trigger;
+		FBox bounds;
+		//Bounding sphere used by the cone test
+		FVector center;
+		float radius;
+	};
+
+	FIntVector cellFor(const FVector& location) const;
+
+	//Calls visitor for the index of every entry that overlaps box. Entries spanning several cells are visited once.
+	template<typename FunctionType>
+	void forEachEntryInBox(const FBox& box, FunctionType visitor) const;
+
+	float cell_size;
+
+	TArray<entry> entries;
+
+	//Cell coordinate to indices into entries
+	TMap<FIntVector, TArray<int32>> cells;
+
+	//Entries already passed to the visitor in the current forEachEntryInBox, kept between queries so they do not allocate
+	mutable TBitArray<> visited;
+};
@@ -0,0 +1,193 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicTriggerInstancing.h"
+#include "PanicTrigger.h"
+#include "StayCalm.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/World.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Trigger Instance Batches"), STAT_TriggerInstanceBatches, STATGROUP_StayCalm);
+
+bool UPanicTriggerInstancing::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* world = Cast<UWorld>(Outer);
+	return world != nullptr && world->IsGameWorld();
+}
+
+void UPanicTriggerInstancing::Deinitialize()
+{
+	batches.Reset();
+	trigger_instances.Reset();
+	SET_DWORD_STAT(STAT_TriggerInstanceBatches, 0);
+	instances_actor = nullptr;
+
+	Super::Deinitialize();
+}
+
+UPanicTriggerInstancing::batch_key UPanicTriggerInstancing::keyFor(const APanicTrigger* trigger)
+{
+	return batch_key(trigger->trigger_mesh->GetStaticMesh(), trigger->trigger_mesh->GetMaterial(0));
+}
+
+bool UPanicTriggerInstancing::addTrigger(APanicTrigger* trigger)
+{
+	if (trigger == nullptr || trigger->trigger_mesh == nullptr || trigger->trigger_mesh->GetStaticMesh() == nullptr
+		|| trigger->trigger_mesh->Mobility == EComponentMobility::Movable)
+	{
+		return false;
+	}
+
+	batch* existing = nullptr;
+	if (findInstance(trigger, existing) != INDEX_NONE)
+	{
+		return true;
+	}
+
+	LLM_SCOPE_BYTAG(StayCalm_PanicFX);
+	batch& owner = findOrAddBatch(trigger);
+	if (owner.component == nullptr)
+	{
+		return false;
+	}
+
+	const int32 instance = owner.component->AddInstanceWorldSpace(trigger->trigger_mesh->GetComponentTransform());
+	owner.triggers.Add(trigger);
+	check(owner.triggers.Num() == owner.component->GetInstanceCount());
+	trigger_instances.Add(trigger, { keyFor(trigger), instance });
+	applyInstance(owner, instance, trigger);
+	return true;
+}
+
+void UPanicTriggerInstancing::removeTrigger(APanicTrigger* trigger)
+{
+	batch* owner = nullptr;
+	const int32 instance = findInstance(trigger, owner);
+	if (instance == INDEX_NONE)
+	{
+		return;
+	}
+
+	//The last instance takes the freed slot, so nothing after it has to shift
+	const int32 last = owner->triggers.Num() - 1;
+	if (instance != last)
+	{
+		const TWeakObjectPtr<APanicTrigger> moved = owner->triggers[last];
+		owner->triggers[instance] = moved;
+		if (instance_location* moved_location = trigger_instances.Find(moved))
+		{
+			moved_location->instance = instance;
+		}
+
+		if (owner->component != nullptr)
+		{
+			if (APanicTrigger* moved_trigger = moved.Get())
+			{
+				applyInstance(*owner, instance, moved_trigger);
+			}
+			else
+			{
+				//A trigger destroyed without ending play draws nothing
+				owner->component->UpdateInstanceTransform(instance, FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), true, false, true);
+			}
+		}
+	}
+
+	if (owner->component != nullptr)
+	{
+		owner->component->RemoveInstance(last);
+	}
+	owner->triggers.RemoveAt(last, 1, false);
+	trigger_instances.Remove(trigger);
+}
+
+void UPanicTriggerInstancing::updateTrigger(APanicTrigger* trigger)
+{
+	batch* owner = nullptr;
+	const int32 instance = findInstance(trigger, owner);
+	if (instance != INDEX_NONE && owner->component != nullptr)
+	{
+		applyInstance(*owner, instance, trigger);
+	}
+}
+
+int32 UPanicTriggerInstancing::findInstance(const APanicTrigger* trigger, batch*& out_batch)
+{
+	out_batch = nullptr;
+	if (trigger == nullptr)
+	{
+		return INDEX_NONE;
+	}
+
+	const instance_location* location = trigger_instances.Find(trigger);
+	if (location == nullptr)
+	{
+		return INDEX_NONE;
+	}
+
+	//Found by the key the trigger was added under, in case its mesh or material changed since
+	out_batch = batches.Find(location->key);
+	return out_batch != nullptr ? location->instance : INDEX_NONE;
+}
+
+UPanicTriggerInstancing::batch& UPanicTriggerInstancing::findOrAddBatch(const APanicTrigger* trigger)
+{
+	const batch_key key = keyFor(trigger);
+	if (batch* found = batches.Find(key))
+	{
+		return *found;
+	}
+
+	batch& added = batches.Add(key);
+
+	UWorld* world = GetWorld();
+	if (instances_actor == nullptr && world != nullptr)
+	{
+		FActorSpawnParameters parameters;
+		parameters.Name = TEXT("PanicTriggerInstances");
+		parameters.ObjectFlags |= RF_Transient;
+		parameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		instances_actor = world->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, parameters);
+
+		USceneComponent* root = NewObject<USceneComponent>(instances_actor, TEXT("Root"));
+		instances_actor->SetRootComponent(root);
+		root->RegisterComponent();
+	}
+	if (instances_actor == nullptr)
+	{
+		return added;
+	}
+
+	const UStaticMeshComponent* source = trigger->trigger_mesh;
+	UInstancedStaticMeshComponent* component = NewObject<UInstancedStaticMeshComponent>(instances_actor);
+	//Created at runtime, so there is no baked lighting to keep it static for
+	component->SetMobility(EComponentMobility::Movable);
+	component->SetupAttachment(instances_actor->GetRootComponent());
+	component->SetStaticMesh(source->GetStaticMesh());
+	component->SetMaterial(0, source->GetMaterial(0));
+	component->SetCastShadow(source->CastShadow);
+	//Traces hit the triggers' own meshes
+	component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	component->SetCanEverAffectNavigation(false);
+	component->NumCustomDataFloats = PanicTriggerMaterial::num_custom_data;
+	component->RegisterComponent();
+	instances_actor->AddInstanceComponent(component);
+
+	added.component = component;
+	SET_DWORD_STAT(STAT_TriggerInstanceBatches, batches.Num());
+	UE_LOG(LogStayCalm, Verbose, TEXT("New trigger instance batch for %s"), *GetNameSafe(source->GetStaticMesh()));
+	return added;
+}
+
+void UPanicTriggerInstancing::applyInstance(const batch& owner, int32 instance, APanicTrigger* trigger)
+{
+	//Hidden triggers keep their instance so the order does not change, scaled down to nothing
+	FTransform transform = trigger->trigger_mesh->GetComponentTransform();
+	if (trigger->IsHidden())
+	{
+		transform.SetScale3D(FVector::ZeroVector);
+	}
+
+	owner.component->UpdateInstanceTransform(instance, transform, true, false, true);
+	owner.component->SetCustomDataValue(instance, PanicTriggerMaterial::active_index, trigger->get_panic_trigger_active() ? 1.0f : 0.0f, true);
+}
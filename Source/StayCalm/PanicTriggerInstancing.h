@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "PanicTriggerInstancing.generated.h"
+
+class APanicTrigger;
+class UInstancedStaticMeshComponent;
+class UMaterialInterface;
+class UStaticMesh;
+
+/**
+ * Draws panic triggers that share a mesh and material as instances of one instanced static mesh, so many triggers cost
+ * one draw call. The trigger keeps its own mesh component for collision and sight traces, with rendering turned off.
+ * Each instance carries the trigger's active state in its custom data at the same index the trigger uses for custom
+ * primitive data, and hidden triggers are scaled to nothing. Removing a trigger moves the last instance of its batch
+ * into the freed slot.
+ * Only triggers whose mesh is not movable are batched, since instances are not moved with their trigger.
+ */
+UCLASS()
+class STAYCALM_API UPanicTriggerInstancing : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+
+	/**
+	* Adds an instance for the trigger's mesh
+	* @return False if the trigger cannot be batched and should draw its own mesh
+	**/
+	bool addTrigger(APanicTrigger* trigger);
+
+	void removeTrigger(APanicTrigger* trigger);
+
+	//Called by a batched trigger when its visibility or active state changes
+	void updateTrigger(APanicTrigger* trigger);
+
+	//Number of instanced meshes drawing triggers, one draw call each
+	inline int32 getBatchCount() const { return batches.Num(); }
+
+private:
+	typedef TPair<const UStaticMesh*, const UMaterialInterface*> batch_key;
+
+	struct batch
+	{
+		UInstancedStaticMeshComponent* component = nullptr;
+		//Trigger for each instance, in instance order
+		TArray<TWeakObjectPtr<APanicTrigger>> triggers;
+	};
+
+	//Where a trigger's instance lives. The key is kept rather than the batch, since adding a batch can move the others.
+	struct instance_location
+	{
+		batch_key key;
+		int32 instance = INDEX_NONE;
+	};
+
+	static batch_key keyFor(const APanicTrigger* trigger);
+
+	//Instance for the trigger, or INDEX_NONE with out_batch left null
+	int32 findInstance(const APanicTrigger* trigger, batch*& out_batch);
+
+	batch& findOrAddBatch(const APanicTrigger* trigger);
+
+	//Writes the trigger's transform and active state to its instance
+	static void applyInstance(const batch& owner, int32 instance, APanicTrigger* trigger);
+
+	//Holds the instanced meshes, which keep the meshes and materials they draw alive
+	UPROPERTY(Transient)
+		AActor* instances_actor;
+
+	TMap<batch_key, batch> batches;
+
+	//Instance of every batched trigger, so lookups do not search the batches
+	TMap<TWeakObjectPtr<const APanicTrigger>, instance_location> trigger_instances;
+};
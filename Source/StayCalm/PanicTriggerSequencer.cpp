@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicTriggerSequencer.h"
+#include "PanicTrigger.h"
+
+void FPanicTriggerSequencer::reset()
+{
+	heap.Reset();
+	added.Reset();
+	next_order = 0;
+}
+
+bool FPanicTriggerSequencer::add(APanicTrigger* trigger)
+{
+	if (trigger == nullptr)
+	{
+		return false;
+	}
+
+	bool already_added = false;
+	added.Add(trigger, &already_added);
+	if (already_added)
+	{
+		return false;
+	}
+
+	heap.HeapPush(entry{ trigger, trigger->get_panic_level(), next_order++ }, entry_less());
+	return true;
+}
+
+APanicTrigger* FPanicTriggerSequencer::activateNext()
+{
+	while (heap.Num() > 0)
+	{
+		entry top;
+		heap.HeapPop(top, entry_less(), false);
+
+		//Skips triggers whose level was streamed out or that were destroyed
+		if (APanicTrigger* trigger = top.trigger.Get())
+		{
+			trigger->set_is_visible(true);
+			trigger->set_panic_trigger_active(true);
+			return trigger;
+		}
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class APanicTrigger;
+
+/**
+ * Hands out panic triggers one at a time in order of panic level.
+ * Triggers are kept in a min-heap so adding and activating are O(log n). Triggers that share a panic level
+ * are activated in the order they were added. Triggers are held weakly and ones destroyed before their turn are skipped.
+ * A trigger is only ever queued once, so one that registers again is not activated a second time.
+ */
+class STAYCALM_API FPanicTriggerSequencer
+{
+public:
+	//Removes every trigger that has not been activated yet and forgets the ones that have
+	void reset();
+
+	/**
+	* Queues a trigger to be activated after every trigger with a lower panic level.
+	* @param trigger - trigger to queue. Its panic level is read once, when it is added.
+	* @return False if the trigger is nullptr or was already added, whether or not it has been activated since
+	**/
+	bool add(APanicTrigger* trigger);
+
+	/**
+	* Shows and activates the next trigger in the sequence and removes it from the queue.
+	* @return The trigger that was activated, or nullptr if the sequence is finished
+	**/
+	APanicTrigger* activateNext();
+
+	//Number of triggers waiting to be activated
+	inline int32 num() const { return heap.Num(); }
+
+private:
+	struct entry
+	{
+		TWeakObjectPtr<APanicTrigger> trigger;
+		int32 panic_level;
+		//Order the trigger was added in. Breaks ties between triggers with the same panic level.
+		uint32 order;
+	};
+
+	struct entry_less
+	{
+		inline bool operator()(const entry& a, const entry& b) const
+		{
+			return a.panic_level != b.panic_level ? a.panic_level < b.panic_level : a.order < b.order;
+		}
+	};
+
+	TArray<entry> heap;
+
+	uint32 next_order = 0;
+
+	//Every trigger queued since the last reset, including ones already activated
+	TSet<TWeakObjectPtr<APanicTrigger>> added;
+};
@@ -0,0 +1,174 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PanicTriggerSubsystem.h"
+#include "PanicTrigger.h"
+#include "StayCalm.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Rebuild Sensing Grid"), STAT_RebuildSensingGrid, STATGROUP_StayCalm);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Registered Triggers"), STAT_RegisteredTriggers, STATGROUP_StayCalm);
+
+bool UPanicTriggerSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* world = Cast<UWorld>(Outer);
+	return world != nullptr && world->IsGameWorld();
+}
+
+void UPanicTriggerSubsystem::Deinitialize()
+{
+	triggers.Reset();
+	trigger_states.Reset();
+	trigger_indices.Reset();
+	sensing_grid.rebuild(triggers);
+	on_trigger_registered.Clear();
+
+	Super::Deinitialize();
+}
+
+void UPanicTriggerSubsystem::registerTrigger(APanicTrigger* trigger)
+{
+	if (trigger == nullptr)
+	{
+		return;
+	}
+
+	if (indexOf(trigger) == INDEX_NONE)
+	{
+		LLM_SCOPE_BYTAG(StayCalm_Sensing);
+		trigger_indices.Add(trigger, triggers.Add(trigger));
+		trigger_states.AddDefaulted();
+		trigger_states.Last().live = trigger->get_is_visible() && trigger->get_panic_trigger_active();
+	}
+	sensing_grid_dirty = true;
+
+	on_trigger_registered.Broadcast(trigger);
+}
+
+void UPanicTriggerSubsystem::unregisterTrigger(APanicTrigger* trigger)
+{
+	//Also drops any trigger that was garbage collected without ending play
+	for (int32 index = triggers.Num() - 1; index >= 0; index--)
+	{
+		if (!triggers[index].IsValid() || triggers[index].Get() == trigger)
+		{
+			removeAt(index);
+		}
+	}
+	sensing_grid_dirty = true;
+}
+
+void UPanicTriggerSubsystem::notifyTriggerStateChanged(APanicTrigger* trigger)
+{
+	sensing_grid_dirty = true;
+
+	const int32 index = indexOf(trigger);
+	if (index != INDEX_NONE)
+	{
+		const bool live = trigger->get_is_visible() && trigger->get_panic_trigger_active();
+		if (live && !trigger_states[index].live)
+		{
+			trigger_states[index].active_time = 0.0f;
+		}
+		trigger_states[index].live = live;
+	}
+}
+
+void UPanicTriggerSubsystem::reportSighted(APanicTrigger* trigger)
+{
+	const int32 index = indexOf(trigger);
+	if (index != INDEX_NONE)
+	{
+		trigger_states[index].sighted = true;
+	}
+}
+
+float UPanicTriggerSubsystem::getActiveTime(const APanicTrigger* trigger) const
+{
+	const int32 index = indexOf(trigger);
+	return index != INDEX_NONE ? trigger_states[index].active_time : 0.0f;
+}
+
+float UPanicTriggerSubsystem::getDwellTime(const APanicTrigger* trigger) const
+{
+	const int32 index = indexOf(trigger);
+	return index != INDEX_NONE ? trigger_states[index].dwell_time : 0.0f;
+}
+
+int32 UPanicTriggerSubsystem::indexOf(const APanicTrigger* trigger) const
+{
+	if (trigger == nullptr)
+	{
+		return INDEX_NONE;
+	}
+
+	const int32* index = trigger_indices.Find(const_cast<APanicTrigger*>(trigger));
+	return index != nullptr ? *index : INDEX_NONE;
+}
+
+void UPanicTriggerSubsystem::removeAt(int32 index)
+{
+	//Stale entries still hash and compare by object index, so they are found and removed too
+	trigger_indices.Remove(triggers[index]);
+	triggers.RemoveAtSwap(index, 1, false);
+	trigger_states.RemoveAtSwap(index, 1, false);
+
+	//The last trigger was swapped into the gap
+	if (index < triggers.Num())
+	{
+		trigger_indices.Add(triggers[index], index);
+	}
+}
+
+void UPanicTriggerSubsystem::Tick(float DeltaTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(UPanicTriggerSubsystem::Tick);
+	SET_DWORD_STAT(STAT_RegisteredTriggers, trigger_states.Num());
+
+	for (trigger_state& state : trigger_states)
+	{
+		if (state.live)
+		{
+			state.active_time += DeltaTime;
+			if (state.sighted)
+			{
+				state.dwell_time += DeltaTime;
+			}
+		}
+		state.sighted = false;
+	}
+}
+
+ETickableTickType UPanicTriggerSubsystem::GetTickableTickType() const
+{
+	//The class default object is never part of a world
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+bool UPanicTriggerSubsystem::IsTickable() const
+{
+	return trigger_states.Num() > 0;
+}
+
+UWorld* UPanicTriggerSubsystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+TStatId UPanicTriggerSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPanicTriggerSubsystem, STATGROUP_StayCalm);
+}
+
+const FPanicTriggerGrid& UPanicTriggerSubsystem::getSensingGrid()
+{
+	if (sensing_grid_dirty)
+	{
+		STAYCALM_SCOPE_CYCLE_COUNTER(STAT_RebuildSensingGrid);
+		LLM_SCOPE_BYTAG(StayCalm_Sensing);
+		sensing_grid.rebuild(triggers);
+		sensing_grid_dirty = false;
+	}
+
+	return sensing_grid;
+}
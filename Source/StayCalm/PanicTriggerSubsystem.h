@@ -0,0 +1,87 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "PanicTriggerGrid.h"
+#include "PanicTriggerSubsystem.generated.h"
+
+class APanicTrigger;
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnPanicTriggerRegistered, APanicTrigger*);
+
+/**
+ * Registry of the panic triggers in a world. Triggers add themselves in BeginPlay and remove themselves in EndPlay,
+ * so triggers in sub-levels that stream in later are picked up without searching every actor.
+ * Triggers do not tick themselves. Their per-frame state is updated here in one pass over a compact array.
+ */
+UCLASS()
+class STAYCALM_API UPanicTriggerSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Deinitialize() override;
+
+	// FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual bool IsTickable() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	void registerTrigger(APanicTrigger* trigger);
+
+	void unregisterTrigger(APanicTrigger* trigger);
+
+	//Called by a trigger when its visibility or active state changes so the sensing grid is rebuilt
+	void notifyTriggerStateChanged(APanicTrigger* trigger);
+
+	//Every trigger currently in the world. Entries can be stale if a trigger was destroyed without ending play.
+	inline const TArray<TWeakObjectPtr<APanicTrigger>>& getTriggers() const { return triggers; }
+
+	//Live triggers bucketed by location. Rebuilt here if a trigger changed state since it was last used.
+	const FPanicTriggerGrid& getSensingGrid();
+
+	//Called by sensing when a ray reaches the trigger this frame. Adds to the trigger's dwell time.
+	void reportSighted(APanicTrigger* trigger);
+
+	float getActiveTime(const APanicTrigger* trigger) const;
+
+	float getDwellTime(const APanicTrigger* trigger) const;
+
+	//Broadcast after a trigger registers, including triggers from levels streamed in after play started
+	FOnPanicTriggerRegistered on_trigger_registered;
+
+private:
+	//Per-frame state for one trigger. Kept at the same index as the trigger in triggers.
+	struct trigger_state
+	{
+		float active_time = 0.0f;
+		float dwell_time = 0.0f;
+		//Cached from the trigger when it changes state so the tick does not touch the actor
+		bool live = false;
+		//Set by reportSighted and cleared every tick
+		bool sighted = false;
+	};
+
+	int32 indexOf(const APanicTrigger* trigger) const;
+
+	//Swaps the last trigger into the index and updates its entry in trigger_indices
+	void removeAt(int32 index);
+
+	TArray<TWeakObjectPtr<APanicTrigger>> triggers;
+
+	TArray<trigger_state> trigger_states;
+
+	//Index of each trigger in triggers, so lookups from sensing do not scan the array
+	TMap<TWeakObjectPtr<APanicTrigger>, int32> trigger_indices;
+
+	FPanicTriggerGrid sensing_grid;
+
+	bool sensing_grid_dirty = true;
+};
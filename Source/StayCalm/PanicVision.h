@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PanicVision.generated.h"
+
+/**
+ * Describes what the character can see when looking for panic triggers.
+ * The foveal zone is a narrow cone straight ahead (main sight). The peripherial zone spans yaw and pitch around it
+ * and is sampled by a fan of rays.
+ */
+USTRUCT(BlueprintType)
+struct STAYCALM_API FPanicVisionSettings
+{
+	GENERATED_BODY()
+
+	//Half angle in degrees of the main sight cone around the camera forward
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0", ClampMax = "89.0"))
+	float foveal_half_angle = 10.0f;
+
+	//How far main sight can see
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0"))
+	float foveal_range = 500.0f;
+
+	//Half angle in degrees of peripherial vision to either side
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0", ClampMax = "89.0"))
+	float peripherial_yaw_half_angle = 35.0f;
+
+	//Half angle in degrees of peripherial vision above and below
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0", ClampMax = "89.0"))
+	float peripherial_pitch_half_angle = 20.0f;
+
+	//How far peripherial vision can see next to main sight
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0"))
+	float peripherial_range = 1000.0f;
+
+	//Fraction of peripherial_range that can still be seen at the outer edge of peripherial vision. The range falls off linearly towards the edge.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float peripherial_edge_range_scale = 1.0f;
+
+	//Number of fan rays spread across the peripherial yaw
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1"))
+	int32 yaw_ray_count = 5;
+
+	//Number of fan rays spread across the peripherial pitch
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1"))
+	int32 pitch_ray_count = 3;
+
+	//Most fan rays traced towards a single trigger. A trigger that no fan ray crosses gets one ray aimed at its center.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Panic, meta = (ClampMin = "1"))
+	int32 max_rays_per_trigger = 2;
+
+	//Widest angle from forward in degrees that either zone can see
+	float maxHalfAngle() const
+	{
+		return FMath::Max3(foveal_half_angle, peripherial_yaw_half_angle, peripherial_pitch_half_angle);
+	}
+
+	//Furthest distance that either zone can see
+	float maxRange() const
+	{
+		return FMath::Max(foveal_range, peripherial_range);
+	}
+
+	/**
+	* Works out which zone a direction falls into and how far can be seen along it.
+	* Main sight lies inside peripherial vision, so past foveal_range a direction in main sight is still seen by peripherial
+	* vision as far as it reaches there.
+	* @param local_direction - unit direction in camera space (X forward, Y right, Z up)
+	* @param distance - how far away the target is, used to tell main sight from peripherial vision beyond foveal_range
+	* @param out_peripherial - set to true for the peripherial zone and false for main sight
+	* @return The sight range along the direction, or 0 if it cannot be seen
+	**/
+	float rangeFor(const FVector& local_direction, float distance, bool& out_peripherial) const
+	{
+		const float angle_from_forward = FMath::RadiansToDegrees(FMath::Acos(FMath::Clamp(local_direction.X, -1.0f, 1.0f)));
+		const bool in_main_sight = angle_from_forward <= foveal_half_angle;
+		if (in_main_sight && distance <= foveal_range)
+		{
+			out_peripherial = false;
+			return foveal_range;
+		}
+
+		const float peripherial_range_here = peripherialRangeFor(local_direction);
+		if (in_main_sight && peripherial_range_here <= foveal_range)
+		{
+			out_peripherial = false;
+			return foveal_range;
+		}
+
+		out_peripherial = peripherial_range_here > 0.0f;
+		return peripherial_range_here;
+	}
+
+	//How far peripherial vision sees along a camera space direction, or 0 outside it
+	float peripherialRangeFor(const FVector& local_direction) const
+	{
+		const float yaw = FMath::Abs(FMath::RadiansToDegrees(FMath::Atan2(local_direction.Y, local_direction.X)));
+		const float pitch = FMath::Abs(FMath::RadiansToDegrees(FMath::Atan2(local_direction.Z, FVector2D(local_direction.X, local_direction.Y).Size())));
+		if (yaw > peripherial_yaw_half_angle || pitch > peripherial_pitch_half_angle)
+		{
+			return 0.0f;
+		}
+
+		//0 straight ahead, 1 at the edge of peripherial vision
+		const float eccentricity = FMath::Max(
+			peripherial_yaw_half_angle > 0.0f ? yaw / peripherial_yaw_half_angle : 0.0f,
+			peripherial_pitch_half_angle > 0.0f ? pitch / peripherial_pitch_half_angle : 0.0f);
+
+		return peripherial_range * FMath::Lerp(1.0f, peripherial_edge_range_scale, eccentricity);
+	}
+};
@@ -3,6 +3,7 @@
 
 #include "PauseMenuWidget.h"
 #include "Kismet/GameplayStatics.h"
+#include "PanicHitchWatchdog.h"
 
 
 void UPauseMenuWidget::set_is_paused(bool new_is_paused)
@@ -18,6 +19,8 @@ bool UPauseMenuWidget::get_is_paused()
 
 void UPauseMenuWidget::show()
 {
+	UPanicHitchWatchdog::noteEvent(this, PanicHitchEvent::WidgetShown);
+
 	//Show Pause Widget
 	AddToViewport();
 	set_is_paused(true);
@@ -36,6 +39,7 @@ void UPauseMenuWidget::hide()
 	playerController->SetShowMouseCursor(false);
 
 	// Remove Pause Menu Screen
+	UPanicHitchWatchdog::noteEvent(this, PanicHitchEvent::WidgetHidden);
 	RemoveFromParent();
 	set_is_paused(false);
 
@@ -0,0 +1,241 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SensingBenchmarkCommandlet.h"
+#include "StayCalm.h"
+#include "StayCalmCharacter.h"
+#include "PanicTrigger.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "GameFramework/WorldSettings.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace SensingBenchmark
+{
+	//Triggers and occluders are scattered over a square this wide, centered on the origin
+	constexpr float area_size = 20000.0f;
+
+	//The view circles the center of the area at this radius and height
+	constexpr float path_radius = 6000.0f;
+	constexpr float eye_height = 160.0f;
+
+	//Simulated frame time. The world is ticked at this rate between sensing passes.
+	constexpr float frame_time = 1.0f / 60.0f;
+
+	//Same layout every run so results can be compared
+	constexpr int32 layout_seed = 0x5CA1;
+}
+
+UStayCalmSensingBenchmarkCommandlet::UStayCalmSensingBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UStayCalmSensingBenchmarkCommandlet::Main(const FString& Params)
+{
+	FString trigger_list = TEXT("10,100,1000,10000");
+	FParse::Value(*Params, TEXT("Triggers="), trigger_list);
+
+	int32 occluder_count = 200;
+	FParse::Value(*Params, TEXT("Occluders="), occluder_count);
+
+	int32 frame_count = 600;
+	FParse::Value(*Params, TEXT("Frames="), frame_count);
+	frame_count = FMath::Max(frame_count, 1);
+
+	FString output_path = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmarks"), TEXT("SensingBenchmark"));
+	FParse::Value(*Params, TEXT("Output="), output_path);
+
+	IConsoleVariable* async_sensing = IConsoleManager::Get().FindConsoleVariable(TEXT("StayCalm.Sensing.Async"));
+	if (async_sensing != nullptr)
+	{
+		async_sensing->Set(FParse::Param(*Params, TEXT("Async")) ? 1 : 0);
+	}
+
+	TArray<FString> trigger_counts;
+	trigger_list.ParseIntoArray(trigger_counts, TEXT(","));
+
+	TArray<result> results;
+	bool sensing_dead = false;
+	for (const FString& trigger_count : trigger_counts)
+	{
+		const int32 triggers = FCString::Atoi(*trigger_count);
+		if (triggers <= 0)
+		{
+			UE_LOG(LogStayCalm, Warning, TEXT("Skipping trigger count '%s'"), *trigger_count);
+			continue;
+		}
+
+		const result measured = measure(triggers, occluder_count, frame_count);
+		UE_LOG(LogStayCalm, Display, TEXT("%6d triggers: p50 %8.2fus  p95 %8.2fus  p99 %8.2fus  max %8.2fus  (%.1f candidates, %.1f rays)"),
+			measured.triggers, measured.p50_us, measured.p95_us, measured.p99_us, measured.max_us, measured.mean_candidates, measured.mean_rays);
+		results.Add(measured);
+
+		//Live triggers all around the path must give candidates and rays, otherwise the run timed nothing
+		if (measured.mean_candidates == 0.0 || measured.mean_rays == 0.0)
+		{
+			UE_LOG(LogStayCalm, Error, TEXT("%d triggers gave no sight candidates or rays. Sensing did not run."), measured.triggers);
+			sensing_dead = true;
+		}
+	}
+
+	const bool written = writeResults(results, output_path);
+	return written && !sensing_dead ? 0 : 1;
+}
+
+UStayCalmSensingBenchmarkCommandlet::result UStayCalmSensingBenchmarkCommandlet::measure(int32 trigger_count, int32 occluder_count, int32 frame_count)
+{
+	using namespace SensingBenchmark;
+
+	result measured;
+	measured.triggers = trigger_count;
+	measured.occluders = occluder_count;
+	measured.frames = frame_count;
+
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false, TEXT("SensingBenchmark"));
+	FWorldContext& world_context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	world_context.SetCurrentWorld(world);
+	world->AddToRoot();
+
+	world->InitializeActorsForPlay(FURL());
+	world->BeginPlay();
+	//Play is normally started by the game mode, which needs a game instance. Without this no actor runs BeginPlay,
+	//triggers never register and sensing returns straight away.
+	world->GetWorldSettings()->NotifyBeginPlay();
+
+	UStaticMesh* cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	FRandomStream layout(layout_seed);
+	const float half_area = area_size * 0.5f;
+
+	FActorSpawnParameters spawn_parameters;
+	spawn_parameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	//Walls that block sight between the view and the triggers
+	for (int32 index = 0; index < occluder_count; index++)
+	{
+		const FVector location(layout.FRandRange(-half_area, half_area), layout.FRandRange(-half_area, half_area), 200.0f);
+		const FRotator rotation(0.0f, layout.FRandRange(0.0f, 180.0f), 0.0f);
+		AStaticMeshActor* occluder = world->SpawnActor<AStaticMeshActor>(location, rotation, spawn_parameters);
+		UStaticMeshComponent* mesh = occluder->GetStaticMeshComponent();
+		mesh->SetMobility(EComponentMobility::Movable);
+		mesh->SetStaticMesh(cube);
+		mesh->SetWorldScale3D(FVector(6.0f, 0.5f, 4.0f));
+		mesh->SetCollisionObjectType(ECC_WorldStatic);
+	}
+
+	AStayCalmCharacter* character = world->SpawnActor<AStayCalmCharacter>(FVector(0.0f, 0.0f, eye_height), FRotator::ZeroRotator, spawn_parameters);
+
+	//Every trigger is visible and active so each one costs what a live trigger costs
+	for (int32 index = 0; index < trigger_count; index++)
+	{
+		const FVector location(layout.FRandRange(-half_area, half_area), layout.FRandRange(-half_area, half_area), layout.FRandRange(50.0f, 300.0f));
+		APanicTrigger* trigger = world->SpawnActor<APanicTrigger>(location, FRotator::ZeroRotator, spawn_parameters);
+		trigger->panic_level = 1 + (index % 5);
+		trigger->trigger_mesh->SetMobility(EComponentMobility::Movable);
+		trigger->trigger_mesh->SetStaticMesh(cube);
+		trigger->trigger_mesh->SetWorldLocation(location);
+		trigger->trigger_mesh->SetCollisionObjectType(ECC_GameTraceChannel3);
+		trigger->set_is_visible(true);
+		trigger->set_panic_trigger_active(true);
+	}
+
+	//Let registration, the deferred first activation and physics settle before timing
+	for (int32 frame = 0; frame < 4; frame++)
+	{
+		world->Tick(LEVELTICK_All, frame_time);
+	}
+
+	TArray<double> samples;
+	samples.Reserve(frame_count);
+	int64 total_candidates = 0;
+	int64 total_rays = 0;
+
+	for (int32 frame = 0; frame < frame_count; frame++)
+	{
+		//One lap around the area over the run, looking slightly inwards and sweeping up and down
+		const float lap = (float)frame / frame_count;
+		const float angle = lap * 2.0f * PI;
+		const FVector eye(FMath::Cos(angle) * path_radius, FMath::Sin(angle) * path_radius, eye_height);
+		const FRotator view(FMath::Sin(lap * 8.0f * PI) * 15.0f, FMath::RadiansToDegrees(angle) + 120.0f, 0.0f);
+
+		const uint64 start_cycles = FPlatformTime::Cycles64();
+		character->senseFromView(eye, view.Quaternion());
+		const uint64 end_cycles = FPlatformTime::Cycles64();
+
+		samples.Add(FPlatformTime::ToMilliseconds64(end_cycles - start_cycles) * 1000.0);
+		total_candidates += character->getSightCandidateCount();
+		total_rays += character->getSightRayCount();
+
+		//Dispatches the frame's sightings and steps trigger state, as in game
+		world->Tick(LEVELTICK_All, frame_time);
+	}
+
+	samples.Sort();
+	double total_us = 0.0;
+	for (double sample : samples)
+	{
+		total_us += sample;
+	}
+
+	measured.mean_us = total_us / samples.Num();
+	measured.p50_us = percentile(samples, 0.50);
+	measured.p95_us = percentile(samples, 0.95);
+	measured.p99_us = percentile(samples, 0.99);
+	measured.max_us = samples.Last();
+	measured.mean_candidates = (double)total_candidates / frame_count;
+	measured.mean_rays = (double)total_rays / frame_count;
+
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+	world->RemoveFromRoot();
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+
+	return measured;
+}
+
+double UStayCalmSensingBenchmarkCommandlet::percentile(const TArray<double>& sorted_samples, double fraction)
+{
+	//Nearest rank
+	const int32 rank = FMath::CeilToInt(fraction * sorted_samples.Num());
+	return sorted_samples[FMath::Clamp(rank - 1, 0, sorted_samples.Num() - 1)];
+}
+
+bool UStayCalmSensingBenchmarkCommandlet::writeResults(const TArray<result>& results, const FString& output_path)
+{
+	FString csv = TEXT("triggers,occluders,frames,mean_us,p50_us,p95_us,p99_us,max_us,mean_candidates,mean_rays\n");
+	FString json = TEXT("{\n\t\"benchmark\": \"panic_sensing\",\n\t\"results\": [\n");
+
+	for (int32 index = 0; index < results.Num(); index++)
+	{
+		const result& row = results[index];
+		csv += FString::Printf(TEXT("%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%.2f\n"),
+			row.triggers, row.occluders, row.frames, row.mean_us, row.p50_us, row.p95_us, row.p99_us, row.max_us, row.mean_candidates, row.mean_rays);
+
+		json += FString::Printf(TEXT("\t\t{ \"triggers\": %d, \"occluders\": %d, \"frames\": %d, \"mean_us\": %.3f, \"p50_us\": %.3f, \"p95_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f, \"mean_candidates\": %.2f, \"mean_rays\": %.2f }%s\n"),
+			row.triggers, row.occluders, row.frames, row.mean_us, row.p50_us, row.p95_us, row.p99_us, row.max_us, row.mean_candidates, row.mean_rays,
+			index + 1 < results.Num() ? TEXT(",") : TEXT(""));
+	}
+	json += TEXT("\t]\n}\n");
+
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(output_path), true);
+	const FString csv_path = output_path + TEXT(".csv");
+	const FString json_path = output_path + TEXT(".json");
+	if (!FFileHelper::SaveStringToFile(csv, *csv_path) || !FFileHelper::SaveStringToFile(json, *json_path))
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("Could not write benchmark results to %s"), *output_path);
+		return false;
+	}
+
+	UE_LOG(LogStayCalm, Display, TEXT("Wrote %s and %s"), *csv_path, *json_path);
+	return true;
+}
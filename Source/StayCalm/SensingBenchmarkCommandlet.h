@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SensingBenchmarkCommandlet.generated.h"
+
+class AStayCalmCharacter;
+
+/**
+ * Measures how panic sensing scales with the number of triggers in a level.
+ * Builds a synthetic world for each trigger count, moves a character's view along a fixed path through it and times
+ * every sensing pass. Writes p50/p95/p99 per trigger count to CSV and JSON so runs can be compared.
+ *
+ * UE4Editor-Cmd StayCalm.uproject -run=StayCalmSensingBenchmark -nullrhi -unattended
+ *   -Triggers=10,100,1000,10000  Trigger counts to measure
+ *   -Occluders=200               Walls placed between the triggers
+ *   -Frames=600                  Sensing passes per trigger count
+ *   -Async                       Measure the async trace path instead of the synchronous one
+ *   -Output=<path>               Results file without extension. Defaults to Saved/Benchmarks/SensingBenchmark
+ */
+UCLASS()
+class UStayCalmSensingBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UStayCalmSensingBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	struct result
+	{
+		int32 triggers = 0;
+		int32 occluders = 0;
+		int32 frames = 0;
+		double mean_us = 0.0;
+		double p50_us = 0.0;
+		double p95_us = 0.0;
+		double p99_us = 0.0;
+		double max_us = 0.0;
+		double mean_candidates = 0.0;
+		double mean_rays = 0.0;
+	};
+
+	//Builds a world with the given number of triggers and occluders and times sensing along the camera path
+	result measure(int32 trigger_count, int32 occluder_count, int32 frame_count);
+
+	static double percentile(const TArray<double>& sorted_samples, double fraction);
+
+	static bool writeResults(const TArray<result>& results, const FString& output_path);
+};
@@ -0,0 +1,563 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SimulationCommandlet.h"
+#include "StayCalm.h"
+#include "StayCalmCharacter.h"
+#include "PanicTrigger.h"
+#include "PanicEventBus.h"
+#include "PanicSession.h"
+#include "PanicScalability.h"
+#include "Camera/CameraComponent.h"
+#include "Components/InputComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/WorldSettings.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+
+namespace SimulationHarness
+{
+	//Walks towards two triggers and stops. Calm movement starts straight away, movement during panic carries on after the input stops.
+	const TCHAR* const default_script[] =
+	{
+		TEXT("0.0 trigger 2 450 0 160"),
+		TEXT("0.0 trigger 4 1400 0 160"),
+		TEXT("0.0 expect sees_ahead 800"),
+		TEXT("0.1 axis MoveForward 1"),
+		TEXT("0.4 expect speed_above 10"),
+		TEXT("1.0 expect panic 2"),
+		TEXT("1.0 expect triggers_left 0"),
+		TEXT("3.0 axis MoveForward 0"),
+		TEXT("3.2 expect speed_above 10"),
+		TEXT("5.0 expect speed_below 1"),
+		TEXT("5.0 expect moved 700"),
+		TEXT("5.0 expect panic 4"),
+		TEXT("5.0 expect sequence_done"),
+	};
+
+	//Frames stepped before the script starts so the character lands on the floor
+	constexpr int32 settle_frames = 30;
+
+	static double microsecondsSince(uint64 start_cycles)
+	{
+		return FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - start_cycles) * 1000.0;
+	}
+}
+
+UStayCalmSimulationCommandlet::UStayCalmSimulationCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UStayCalmSimulationCommandlet::Main(const FString& Params)
+{
+	FString replay_path;
+	if (FParse::Value(*Params, TEXT("Replay="), replay_path))
+	{
+		int32 max_quality_changes = -1;
+		FParse::Value(*Params, TEXT("MaxQualityChanges="), max_quality_changes);
+		float panic_tolerance = 0.01f;
+		FParse::Value(*Params, TEXT("PanicTolerance="), panic_tolerance);
+		return replay(replay_path, max_quality_changes, panic_tolerance);
+	}
+
+	TArray<FString> lines;
+	FString script_path;
+	if (FParse::Value(*Params, TEXT("Script="), script_path))
+	{
+		if (!FFileHelper::LoadFileToStringArray(lines, *script_path))
+		{
+			UE_LOG(LogStayCalm, Error, TEXT("Could not read script %s"), *script_path);
+			return 1;
+		}
+	}
+	else
+	{
+		lines.Append(SimulationHarness::default_script, UE_ARRAY_COUNT(SimulationHarness::default_script));
+	}
+
+	TArray<script_line> script;
+	if (!parseScript(lines, script))
+	{
+		return 1;
+	}
+
+	FString fps_list = TEXT("30,60,144,240");
+	FParse::Value(*Params, TEXT("Fps="), fps_list);
+
+	float tolerance = 10.0f;
+	FParse::Value(*Params, TEXT("Tolerance="), tolerance);
+
+	TArray<FString> fps_values;
+	fps_list.ParseIntoArray(fps_values, TEXT(","));
+
+	TArray<run_result> results;
+	int32 failures = 0;
+	for (const FString& fps_value : fps_values)
+	{
+		const int32 fps = FCString::Atoi(*fps_value);
+		if (fps <= 0)
+		{
+			UE_LOG(LogStayCalm, Warning, TEXT("Skipping frame rate '%s'"), *fps_value);
+			continue;
+		}
+
+		const run_result result = run(script, fps);
+		failures += result.failures;
+
+		logTimings(result);
+		results.Add(result);
+	}
+
+	//Movement delay and panic are meant to feel the same at any frame rate
+	for (int32 a = 0; a < results.Num(); a++)
+	{
+		for (int32 b = a + 1; b < results.Num(); b++)
+		{
+			const float distance = FVector::Dist(results[a].final_location, results[b].final_location);
+			if (distance > tolerance)
+			{
+				UE_LOG(LogStayCalm, Error, TEXT("%d fps and %d fps ended %.1fcm apart"), results[a].fps, results[b].fps, distance);
+				failures++;
+			}
+		}
+	}
+
+	UE_LOG(LogStayCalm, Display, TEXT("Simulation %s with %d failures"), failures == 0 ? TEXT("passed") : TEXT("failed"), failures);
+	return failures == 0 ? 0 : 1;
+}
+
+bool UStayCalmSimulationCommandlet::parseScript(const TArray<FString>& lines, TArray<script_line>& out_script)
+{
+	out_script.Reset();
+	for (int32 index = 0; index < lines.Num(); index++)
+	{
+		const FString line = lines[index].TrimStartAndEnd();
+		if (line.IsEmpty() || line.StartsWith(TEXT("#")))
+		{
+			continue;
+		}
+
+		TArray<FString> words;
+		line.ParseIntoArrayWS(words);
+		if (words.Num() < 2 || !FCString::IsNumeric(*words[0]))
+		{
+			UE_LOG(LogStayCalm, Error, TEXT("Script line %d: expected '<seconds> <command> <arguments>'"), index + 1);
+			return false;
+		}
+
+		script_line parsed;
+		parsed.time = FCString::Atof(*words[0]);
+		parsed.command = FName(*words[1]);
+		parsed.arguments.Append(words.GetData() + 2, words.Num() - 2);
+		parsed.line_number = index + 1;
+		out_script.Add(parsed);
+	}
+
+	//Lines at the same time keep their order
+	out_script.StableSort([](const script_line& a, const script_line& b)
+	{
+		return a.time < b.time;
+	});
+	return true;
+}
+
+UStayCalmSimulationCommandlet::run_result UStayCalmSimulationCommandlet::run(const TArray<script_line>& script, int32 fps)
+{
+	using namespace SimulationHarness;
+
+	run_result result;
+	result.fps = fps;
+	const float frame_time = 1.0f / fps;
+
+	UWorld* world = createWorld(FString());
+	UInputComponent* input = nullptr;
+	AStayCalmCharacter* character = spawnCharacter(world, FVector(0.0f, 0.0f, 100.0f), input);
+
+	for (int32 frame = 0; frame < settle_frames; frame++)
+	{
+		world->Tick(LEVELTICK_All, frame_time);
+	}
+	const FVector start_location = character->GetActorLocation();
+
+	UStaticMesh* cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	FActorSpawnParameters spawn_parameters;
+	spawn_parameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	//Spawned triggers have no trigger_event blueprint to switch them off once they fire, so the harness does it after the
+	//frame. Otherwise a trigger would fire again on every frame it stays in view.
+	TArray<TWeakObjectPtr<APanicTrigger>> fired_triggers;
+	UPanicEventBus* event_bus = world->GetSubsystem<UPanicEventBus>();
+	const FDelegateHandle fired_handle = event_bus->on_sight_events.AddLambda([&fired_triggers](const TArray<FPanicSightEvent>& events)
+	{
+		for (const FPanicSightEvent& event : events)
+		{
+			if (event.active && event.trigger != nullptr)
+			{
+				fired_triggers.AddUnique(event.trigger);
+			}
+		}
+	});
+
+	TMap<FName, float> held_axes;
+	const float end_time = script.Num() > 0 ? script.Last().time : 0.0f;
+	int32 next_line = 0;
+
+	for (int32 frame = 0; ; frame++)
+	{
+		const float now = frame * frame_time;
+
+		//Everything due by the start of this frame
+		while (next_line < script.Num() && script[next_line].time <= now + KINDA_SMALL_NUMBER)
+		{
+			const script_line& line = script[next_line++];
+			if (line.command == TEXT("axis") && line.arguments.Num() == 2)
+			{
+				held_axes.Add(FName(*line.arguments[0]), FCString::Atof(*line.arguments[1]));
+			}
+			else if (line.command == TEXT("trigger") && line.arguments.Num() == 4)
+			{
+				const FVector location(FCString::Atof(*line.arguments[1]), FCString::Atof(*line.arguments[2]), FCString::Atof(*line.arguments[3]));
+				APanicTrigger* trigger = world->SpawnActor<APanicTrigger>(location, FRotator::ZeroRotator, spawn_parameters);
+				trigger->panic_level = FCString::Atoi(*line.arguments[0]);
+				trigger->trigger_mesh->SetMobility(EComponentMobility::Movable);
+				trigger->trigger_mesh->SetStaticMesh(cube);
+				trigger->trigger_mesh->SetWorldLocation(location);
+				trigger->trigger_mesh->SetWorldScale3D(FVector(0.5f));
+				trigger->trigger_mesh->SetCollisionObjectType(ECC_GameTraceChannel3);
+				//The character walks through triggers rather than into them
+				trigger->trigger_mesh->SetCollisionResponseToChannel(ECC_Pawn, ECR_Ignore);
+			}
+			else if (line.command == TEXT("expect"))
+			{
+				if (!checkExpectation(line, character, start_location))
+				{
+					result.failures++;
+				}
+			}
+			else
+			{
+				UE_LOG(LogStayCalm, Error, TEXT("Script line %d: unknown command '%s'"), line.line_number, *line.command.ToString());
+				result.failures++;
+			}
+		}
+
+		if (now > end_time)
+		{
+			break;
+		}
+
+		//There is no viewport, so sensing looks out of the first person camera directly
+		stepCharacter(character, input, [&held_axes](FName axis) { return held_axes.FindRef(axis); },
+			frame_time, character->GetFirstPersonCameraComponent()->GetComponentLocation(), character->GetControlRotation(), result);
+
+		for (const TWeakObjectPtr<APanicTrigger>& fired : fired_triggers)
+		{
+			if (fired.IsValid())
+			{
+				fired->set_panic_trigger_active(false);
+			}
+		}
+		fired_triggers.Reset();
+	}
+
+	event_bus->on_sight_events.Remove(fired_handle);
+	result.final_location = character->GetActorLocation();
+	destroyWorld(world);
+
+	return result;
+}
+
+int32 UStayCalmSimulationCommandlet::replay(const FString& session_path, int32 max_quality_changes, float panic_tolerance)
+{
+	TArray<uint8> bytes;
+	if (!FFileHelper::LoadFileToArray(bytes, *session_path))
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("Could not read session %s"), *session_path);
+		return 1;
+	}
+
+	FPanicSessionDecoder decoder(bytes);
+	FString map_name;
+	if (!decoder.readHeader(map_name))
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("%s is not a session file this build can read"), *session_path);
+		return 1;
+	}
+
+	TArray<FPanicSessionFrame> frames;
+	FPanicSessionFrame frame;
+	while (decoder.readFrame(frame))
+	{
+		frames.Add(frame);
+	}
+
+	if (frames.Num() == 0)
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("%s has no frames"), *session_path);
+		return 1;
+	}
+	UE_LOG(LogStayCalm, Display, TEXT("Replaying %d frames recorded in %s"), frames.Num(), *map_name);
+
+	UWorld* world = createWorld(map_name);
+
+	//A character placed in the map would sense and activate the triggers alongside the replayed one
+	for (TActorIterator<AStayCalmCharacter> placed(world); placed; ++placed)
+	{
+		placed->Destroy();
+	}
+
+	UInputComponent* input = nullptr;
+	const FVector eye_offset(0.0f, 0.0f, 64.0f);
+	AStayCalmCharacter* character = spawnCharacter(world, frames[0].camera_location - eye_offset, input);
+	APlayerController* controller = Cast<APlayerController>(character->GetController());
+
+	//Decided from the replayed blur without touching the renderer
+	FPanicScalabilityPolicy scalability;
+	scalability.configure(character->scalability_settings);
+	float seconds_at_tier[3] = { 0.0f, 0.0f, 0.0f };
+	float lowest_screen_percentage = 100.0f;
+
+	run_result result;
+	int32 panic_mismatches = 0;
+	for (const FPanicSessionFrame& recorded : frames)
+	{
+		//The recorded camera replaces look input so sensing sees what the player saw
+		if (controller != nullptr)
+		{
+			controller->SetControlRotation(recorded.camera_rotation);
+		}
+
+		stepCharacter(character, input, [&recorded](FName axis)
+		{
+			for (int32 index = 0; index < PanicSessionAxis::Count; index++)
+			{
+				if (PanicSessionAxis::names[index] == axis)
+				{
+					return recorded.axes[index];
+				}
+			}
+			return 0.0f;
+		}, recorded.delta_time, recorded.camera_location, recorded.camera_rotation, result);
+
+		if (character->getPanicLevel() != recorded.panic_level)
+		{
+			panic_mismatches++;
+		}
+
+		scalability.update(character->post_process_controller.getBlur(), recorded.delta_time);
+		seconds_at_tier[scalability.getTier()] += recorded.delta_time;
+		lowest_screen_percentage = FMath::Min(lowest_screen_percentage, scalability.getScreenPercentage());
+	}
+
+	result.fps = 0;
+	result.final_location = character->GetActorLocation();
+	logTimings(result);
+	UE_LOG(LogStayCalm, Display, TEXT("Panic level differed from the recording on %d of %d frames"), panic_mismatches, frames.Num());
+	UE_LOG(LogStayCalm, Display, TEXT("Scalability: %d tier changes, %.1fs full, %.1fs reduced, %.1fs low, lowest screen percentage %.0f"),
+		scalability.getTierChanges(), seconds_at_tier[FPanicScalabilityPolicy::full], seconds_at_tier[FPanicScalabilityPolicy::reduced],
+		seconds_at_tier[FPanicScalabilityPolicy::low], lowest_screen_percentage);
+
+	destroyWorld(world);
+
+	//Same input, camera and frame times should give the same panic, give or take the frame a sighting lands on
+	const float mismatch_fraction = (float)panic_mismatches / frames.Num();
+	if (mismatch_fraction > panic_tolerance)
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("Panic level differed on %.1f%% of frames, more than the %.1f%% allowed"), mismatch_fraction * 100.0f, panic_tolerance * 100.0f);
+		return 1;
+	}
+
+	if (max_quality_changes >= 0 && scalability.getTierChanges() > max_quality_changes)
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("Scalability changed tier %d times, more than the %d allowed"), scalability.getTierChanges(), max_quality_changes);
+		return 1;
+	}
+	return 0;
+}
+
+UWorld* UStayCalmSimulationCommandlet::createWorld(const FString& map_name)
+{
+	UWorld* world = nullptr;
+	if (!map_name.IsEmpty() && FPackageName::DoesPackageExist(map_name))
+	{
+		UPackage* package = LoadPackage(nullptr, *map_name, LOAD_None);
+		world = package != nullptr ? UWorld::FindWorldInPackage(package) : nullptr;
+		if (world != nullptr)
+		{
+			world->WorldType = EWorldType::Game;
+			world->InitWorld();
+		}
+	}
+
+	const bool test_map = world == nullptr;
+	if (test_map)
+	{
+		if (!map_name.IsEmpty())
+		{
+			UE_LOG(LogStayCalm, Warning, TEXT("Could not load %s. Using a flat test map."), *map_name);
+		}
+		world = UWorld::CreateWorld(EWorldType::Game, false, TEXT("SimulationHarness"));
+	}
+
+	FWorldContext& world_context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	world_context.SetCurrentWorld(world);
+	world->AddToRoot();
+
+	world->UpdateWorldComponents(true, false);
+	world->InitializeActorsForPlay(FURL());
+	world->BeginPlay();
+	//Play is normally started by the game mode, which needs a game instance. Without this no actor in the world, the
+	//character and triggers included, runs BeginPlay.
+	world->GetWorldSettings()->NotifyBeginPlay();
+
+	//Test map: a flat floor with its top at z = 0
+	if (test_map)
+	{
+		FActorSpawnParameters spawn_parameters;
+		spawn_parameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		AStaticMeshActor* floor = world->SpawnActor<AStaticMeshActor>(FVector(0.0f, 0.0f, -50.0f), FRotator::ZeroRotator, spawn_parameters);
+		floor->GetStaticMeshComponent()->SetMobility(EComponentMobility::Movable);
+		floor->GetStaticMeshComponent()->SetStaticMesh(LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube")));
+		floor->GetStaticMeshComponent()->SetWorldScale3D(FVector(200.0f, 200.0f, 1.0f));
+	}
+
+	return world;
+}
+
+void UStayCalmSimulationCommandlet::destroyWorld(UWorld* world)
+{
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+	world->RemoveFromRoot();
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+}
+
+AStayCalmCharacter* UStayCalmSimulationCommandlet::spawnCharacter(UWorld* world, const FVector& location, UInputComponent*& out_input)
+{
+	FActorSpawnParameters spawn_parameters;
+	spawn_parameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+
+	AStayCalmCharacter* character = world->SpawnActor<AStayCalmCharacter>(location, FRotator::ZeroRotator, spawn_parameters);
+	APlayerController* controller = world->SpawnActor<APlayerController>(spawn_parameters);
+	controller->Possess(character);
+
+	//The same bindings the player's input goes through
+	out_input = NewObject<UInputComponent>(character, TEXT("SimulationInput"));
+	character->SetupPlayerInputComponent(out_input);
+
+	//The harness runs the character's frame itself so each part can be timed
+	character->SetActorTickEnabled(false);
+	return character;
+}
+
+void UStayCalmSimulationCommandlet::stepCharacter(AStayCalmCharacter* character, UInputComponent* input, TFunctionRef<float(FName)> axis_value,
+	float delta_time, const FVector& eye, const FRotator& view, run_result& result)
+{
+	using namespace SimulationHarness;
+
+	//Axis input is delivered before the character ticks, as the player controller does
+	for (FInputAxisBinding& binding : input->AxisBindings)
+	{
+		binding.AxisDelegate.Execute(axis_value(binding.AxisName));
+	}
+
+	//Mirrors AStayCalmCharacter::Tick
+	uint64 start_cycles = FPlatformTime::Cycles64();
+	character->updatePanicSimulation(delta_time);
+	character->post_process_controller.update(delta_time);
+	result.panic_simulation.add(microsecondsSince(start_cycles));
+
+	start_cycles = FPlatformTime::Cycles64();
+	character->executeDelayedMovement(delta_time);
+	result.delayed_movement.add(microsecondsSince(start_cycles));
+
+	start_cycles = FPlatformTime::Cycles64();
+	character->executeDelayedLook(delta_time);
+	result.delayed_look.add(microsecondsSince(start_cycles));
+
+	start_cycles = FPlatformTime::Cycles64();
+	character->senseFromView(eye, view.Quaternion());
+	result.sensing.add(microsecondsSince(start_cycles));
+
+	character->GetWorld()->Tick(LEVELTICK_All, delta_time);
+	result.frames++;
+}
+
+void UStayCalmSimulationCommandlet::logTimings(const run_result& result)
+{
+	const double frames = FMath::Max(result.frames, 1);
+	UE_LOG(LogStayCalm, Display, TEXT("%3d fps: %d failed  end %s  mean/max us: panic %.2f/%.2f  movement %.2f/%.2f  look %.2f/%.2f  sensing %.2f/%.2f"),
+		result.fps, result.failures, *result.final_location.ToCompactString(),
+		result.panic_simulation.total_us / frames, result.panic_simulation.max_us,
+		result.delayed_movement.total_us / frames, result.delayed_movement.max_us,
+		result.delayed_look.total_us / frames, result.delayed_look.max_us,
+		result.sensing.total_us / frames, result.sensing.max_us);
+}
+
+bool UStayCalmSimulationCommandlet::checkExpectation(const script_line& line, AStayCalmCharacter* character, const FVector& start_location) const
+{
+	const FName what = line.arguments.Num() > 0 ? FName(*line.arguments[0]) : NAME_None;
+	const float expected = line.arguments.Num() > 1 ? FCString::Atof(*line.arguments[1]) : 0.0f;
+
+	bool passed = false;
+	float actual = 0.0f;
+	if (what == TEXT("panic"))
+	{
+		actual = character->panicLevel;
+		passed = character->panicLevel == (int)expected;
+	}
+	else if (what == TEXT("triggers_left"))
+	{
+		actual = character->trigger_sequence.num();
+		passed = character->trigger_sequence.num() == (int32)expected;
+	}
+	else if (what == TEXT("sequence_done"))
+	{
+		actual = character->waiting_for_trigger ? 1.0f : 0.0f;
+		passed = character->waiting_for_trigger;
+	}
+	else if (what == TEXT("moved"))
+	{
+		actual = FVector::Dist2D(character->GetActorLocation(), start_location);
+		passed = actual >= expected;
+	}
+	else if (what == TEXT("speed_above"))
+	{
+		actual = character->GetVelocity().Size2D();
+		passed = actual > expected;
+	}
+	else if (what == TEXT("speed_below"))
+	{
+		actual = character->GetVelocity().Size2D();
+		passed = actual < expected;
+	}
+	else if (what == TEXT("sees_ahead"))
+	{
+		//Main sight ends before this distance, so straight ahead must fall back to peripherial vision
+		bool peripherial = false;
+		actual = character->vision.rangeFor(FVector::ForwardVector, expected, peripherial);
+		passed = actual >= expected;
+	}
+	else
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("Script line %d: unknown expectation '%s'"), line.line_number, *what.ToString());
+		return false;
+	}
+
+	if (!passed)
+	{
+		UE_LOG(LogStayCalm, Error, TEXT("Script line %d at %.2fs: expected %s %.2f, was %.2f"), line.line_number, line.time, *what.ToString(), expected, actual);
+	}
+	return passed;
+}
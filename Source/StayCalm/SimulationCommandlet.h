@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SimulationCommandlet.generated.h"
+
+class AStayCalmCharacter;
+class UInputComponent;
+
+/**
+ * Runs the character headless through a script of axis input and checks where it ends up.
+ * Input goes through the bindings made by SetupPlayerInputComponent, the world is stepped at a fixed frame time,
+ * and the script's expectations are checked on position, speed, panic level and trigger sequence progress.
+ * The script runs once per frame rate, the runs must agree with each other, and the cost of the delayed movement
+ * and panic paths is reported for each.
+ *
+ * UE4Editor-Cmd StayCalm.uproject -run=StayCalmSimulation -nullrhi -unattended
+ *   -Script=<path>       Script to run. Runs the built-in scenario when not given.
+ *   -Fps=30,60,144,240   Simulated frame rates
+ *   -Tolerance=10        Largest distance in cm between the final positions of any two frame rates
+ *   -Replay=<path>       Replays a session recorded by UPanicSessionRecorder instead of running a script. The recorded
+ *                        input, camera and frame times are fed back in, in the recorded map if it can be loaded.
+ *                        The panic scalability policy is run against the replayed blur and its decisions reported.
+ *   -MaxQualityChanges=N With -Replay, fails if the scalability policy changes quality tier more than N times
+ *   -PanicTolerance=0.01 With -Replay, largest fraction of frames whose panic level may differ from the recording
+ *
+ * Script lines are "<seconds> <command> <arguments>". Blank lines and lines starting with # are ignored.
+ *   <t> trigger <panic level> <x> <y> <z>   Places a trigger. Triggers are queued in the order of their panic level.
+ *   <t> axis <axis name> <value>            Holds an input axis, e.g. MoveForward, at the value from t on
+ *   <t> expect panic <level>                The last panic level started
+ *   <t> expect triggers_left <count>        Triggers not yet activated
+ *   <t> expect sequence_done                Every trigger has been activated and seen
+ *   <t> expect moved <cm>                   Distance from the start is at least this
+ *   <t> expect speed_above <cm/s>
+ *   <t> expect speed_below <cm/s>
+ *   <t> expect sees_ahead <cm>              A target straight ahead at this distance is in sight range
+ */
+UCLASS()
+class UStayCalmSimulationCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UStayCalmSimulationCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	struct script_line
+	{
+		float time = 0.0f;
+		FName command;
+		TArray<FString> arguments;
+		int32 line_number = 0;
+	};
+
+	struct path_timing
+	{
+		double total_us = 0.0;
+		double max_us = 0.0;
+
+		void add(double sample_us)
+		{
+			total_us += sample_us;
+			max_us = FMath::Max(max_us, sample_us);
+		}
+	};
+
+	struct run_result
+	{
+		int32 fps = 0;
+		int32 frames = 0;
+		int32 failures = 0;
+		FVector final_location = FVector::ZeroVector;
+		path_timing panic_simulation;
+		path_timing delayed_movement;
+		path_timing delayed_look;
+		path_timing sensing;
+	};
+
+	static bool parseScript(const TArray<FString>& lines, TArray<script_line>& out_script);
+
+	//Runs the whole script at one frame rate
+	run_result run(const TArray<script_line>& script, int32 fps);
+
+	/**
+	* Feeds a recorded session back into the character with the recorded frame times
+	* @param max_quality_changes - most scalability tier changes allowed, or negative for no limit
+	* @param panic_tolerance - largest fraction of frames whose panic level may differ from the recording
+	**/
+	int32 replay(const FString& session_path, int32 max_quality_changes, float panic_tolerance);
+
+	//Loads the map if it is given and exists, otherwise makes a test map with a flat floor
+	static UWorld* createWorld(const FString& map_name);
+
+	static void destroyWorld(UWorld* world);
+
+	//Spawns a possessed character with its input bindings set up. Its tick is left to stepCharacter.
+	static AStayCalmCharacter* spawnCharacter(UWorld* world, const FVector& location, UInputComponent*& out_input);
+
+	//Delivers axis input through the bindings, runs the character's frame with each part timed, then ticks the world
+	static void stepCharacter(AStayCalmCharacter* character, UInputComponent* input, TFunctionRef<float(FName)> axis_value,
+		float delta_time, const FVector& eye, const FRotator& view, run_result& result);
+
+	static void logTimings(const run_result& result);
+
+	//Returns false and logs the line if the expectation does not hold
+	bool checkExpectation(const script_line& line, AStayCalmCharacter* character, const FVector& start_location) const;
+};
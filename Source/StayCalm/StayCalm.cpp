@@ -2,6 +2,33 @@
 
 #include "StayCalm.h"
 #include "Modules/ModuleManager.h"
+#include "StayCalmMemory.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, StayCalm, "StayCalm" );
- 
\ No newline at end of file
+DEFINE_LOG_CATEGORY(LogStayCalm);
+
+LLM_DEFINE_TAG(StayCalm);
+//Parented so the sub-tags are listed under StayCalm rather than as separate top-level tags
+LLM_DEFINE_TAG(StayCalm_Sensing, NAME_None, TEXT("StayCalm"));
+LLM_DEFINE_TAG(StayCalm_MovementDelay, NAME_None, TEXT("StayCalm"));
+LLM_DEFINE_TAG(StayCalm_PanicFX, NAME_None, TEXT("StayCalm"));
+LLM_DEFINE_TAG(StayCalm_UI, NAME_None, TEXT("StayCalm"));
+LLM_DEFINE_TAG(StayCalm_Projectiles, NAME_None, TEXT("StayCalm"));
+
+class FStayCalmModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+		memory_tracker.start();
+	}
+
+	virtual void ShutdownModule() override
+	{
+		memory_tracker.stop();
+	}
+
+private:
+	FStayCalmMemoryTracker memory_tracker;
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FStayCalmModule, StayCalm, "StayCalm" );
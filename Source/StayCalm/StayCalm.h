@@ -3,3 +3,30 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "HAL/LowLevelMemTracker.h"
+
+//Game log. Compiled out of shipping builds so per-frame logging costs nothing there.
+#if UE_BUILD_SHIPPING
+DECLARE_LOG_CATEGORY_EXTERN(LogStayCalm, Log, NoLogging);
+#else
+DECLARE_LOG_CATEGORY_EXTERN(LogStayCalm, Log, All);
+#endif
+
+//Shown with "stat StayCalm"
+DECLARE_STATS_GROUP(TEXT("StayCalm"), STATGROUP_StayCalm, STATCAT_Advanced);
+
+//Times the enclosing scope in stat StayCalm and as a CPU event in Unreal Insights
+#define STAYCALM_SCOPE_CYCLE_COUNTER(Stat) \
+	SCOPE_CYCLE_COUNTER(Stat); \
+	TRACE_CPUPROFILER_EVENT_SCOPE(Stat)
+
+//Low level memory tracker tags for what the game module allocates. The sub-tags are defined with StayCalm as their
+//parent, so -llm captures show them under StayCalm.
+LLM_DECLARE_TAG(StayCalm);
+LLM_DECLARE_TAG(StayCalm_Sensing);
+LLM_DECLARE_TAG(StayCalm_MovementDelay);
+LLM_DECLARE_TAG(StayCalm_PanicFX);
+LLM_DECLARE_TAG(StayCalm_UI);
+LLM_DECLARE_TAG(StayCalm_Projectiles);
@@ -14,7 +14,5 @@ class STAYCALM_API UStayCalmCameraComponent : public UCameraComponent
 {
 	GENERATED_BODY()
 
-		//Create methods to update camera settings
-
-		void updateBlurLevel(int level);
+		//Panic blur and field of view are driven by FPanicPostProcessController
 };
@@ -1,6 +1,7 @@
 // Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
 
 #include "StayCalmCharacter.h"
+#include "StayCalm.h"
 #include "StayCalmProjectile.h"
 #include "Animation/AnimInstance.h"
 #include "Camera/CameraComponent.h"
@@ -15,14 +16,74 @@
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "PanicProcessVolume.h"
+#include "PanicProfile.h"
+#include "PanicSessionRecorder.h"
+#include "PanicHitchWatchdog.h"
+#include "PanicTriggerSubsystem.h"
+#include "PanicRoomSubsystem.h"
 #include "Components/PostProcessComponent.h"
 #include "Components/AudioComponent.h"
+#include "Materials/MaterialParameterCollection.h"
 #include "DrawDebugHelpers.h"
 #include "Blueprint/WidgetBlueprintLibrary.h"
+#include "HAL/IConsoleManager.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/PlayerController.h"
 
 
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 
+DECLARE_CYCLE_STAT(TEXT("Panic Line Trace"), STAT_PanicLineTrace, STATGROUP_StayCalm);
+DECLARE_CYCLE_STAT(TEXT("Build Sight Rays"), STAT_BuildSightRays, STATGROUP_StayCalm);
+DECLARE_CYCLE_STAT(TEXT("Execute Delayed Movement"), STAT_ExecuteDelayedMovement, STATGROUP_StayCalm);
+DECLARE_CYCLE_STAT(TEXT("Execute Delayed Look"), STAT_ExecuteDelayedLook, STATGROUP_StayCalm);
+DECLARE_CYCLE_STAT(TEXT("Panic Simulation"), STAT_PanicSimulation, STATGROUP_StayCalm);
+DECLARE_CYCLE_STAT(TEXT("Panic Blueprint Events"), STAT_PanicBlueprintEvents, STATGROUP_StayCalm);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sight Candidates"), STAT_SightCandidates, STATGROUP_StayCalm);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sight Rays Built"), STAT_SightRaysBuilt, STATGROUP_StayCalm);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sight Rays Traced"), STAT_SightRaysTraced, STATGROUP_StayCalm);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sight Hits"), STAT_SightHits, STATGROUP_StayCalm);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Movement Delay Segments"), STAT_MovementDelaySegments, STATGROUP_StayCalm);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Panic Transitions"), STAT_PanicTransitions, STATGROUP_StayCalm);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Panic Blueprint Event Calls"), STAT_PanicBlueprintEventCalls, STATGROUP_StayCalm);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Movement Delay Actual (ms)"), STAT_MovementDelayActualMs, STATGROUP_StayCalm);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Movement Delay Error (ms)"), STAT_MovementDelayErrorMs, STATGROUP_StayCalm);
+
+static TAutoConsoleVariable<int32> CVarStayCalmAsyncSensing(
+	TEXT("StayCalm.Sensing.Async"),
+	0,
+	TEXT("0: panic sight rays are traced synchronously on the game thread.\n")
+	TEXT("1: sight rays are submitted as one async batch and their results are handled at the start of the next frame."),
+	ECVF_Default);
+
+static AStayCalmCharacter* playerCharacter(UWorld* world)
+{
+	APlayerController* controller = world != nullptr ? world->GetFirstPlayerController() : nullptr;
+	return controller != nullptr ? Cast<AStayCalmCharacter>(controller->GetPawn()) : nullptr;
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice StayCalmLatencyDumpCommand(
+	TEXT("StayCalm.Latency.Dump"),
+	TEXT("Prints the movement delay the player actually got at each panic level against the intended delay."),
+	FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world, FOutputDevice& output)
+	{
+		if (AStayCalmCharacter* character = playerCharacter(world))
+		{
+			character->getMovementLatency().dump(output);
+		}
+	}));
+
+static FAutoConsoleCommandWithWorld StayCalmLatencyResetCommand(
+	TEXT("StayCalm.Latency.Reset"),
+	TEXT("Clears the movement delay histogram."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+	{
+		if (AStayCalmCharacter* character = playerCharacter(world))
+		{
+			character->resetMovementLatency();
+		}
+	}));
+
 //////////////////////////////////////////////////////////////////////////
 // AStayCalmCharacter
 
@@ -42,10 +103,17 @@ AStayCalmCharacter::AStayCalmCharacter()
 	FirstPersonCameraComponent->bUsePawnControlRotation = true;
 
 
-	PanicPostProcess = CreateDefaultSubobject<UPostProcessComponent>(TEXT("PanicPostProcess"));
-	PanicPostProcess->SetupAttachment(GetCapsuleComponent());
+	{
+		LLM_SCOPE_BYTAG(StayCalm_PanicFX);
+		PanicPostProcess = CreateDefaultSubobject<UPostProcessComponent>(TEXT("PanicPostProcess"));
+		PanicPostProcess->SetupAttachment(GetCapsuleComponent());
+
+		HeartBeatAudioCue = CreateDefaultSubobject<UAudioComponent>(TEXT("HeartBeatAudio"));
+	}
 
-	HeartBeatAudioCue = CreateDefaultSubobject<UAudioComponent>(TEXT("HeartBeatAudio"));
+	SessionRecorder = CreateDefaultSubobject<UPanicSessionRecorder>(TEXT("SessionRecorder"));
+
+	async_sight_delegate.BindUObject(this, &AStayCalmCharacter::onAsyncSightTrace);
 
 }
 
@@ -57,30 +125,76 @@ void AStayCalmCharacter::BeginPlay()
 	//Stops the heartbeat cue from playing
 	stopPlayingPanicHeartBeat();
 
+	panic_simulation.configure(panic_simulation_settings, maxPanicLevel());
+
+	post_process_controller.initialize(post_process_settings, PanicPostProcess, FirstPersonCameraComponent,
+		panic_parameter_collection != nullptr ? GetWorld()->GetParameterCollectionInstance(panic_parameter_collection) : nullptr);
+	scalability_controller.configure(scalability_settings);
+
 	//Retrieves a list of all of the panic triggers
-	addAllPanicTriggers();
+	{
+		LLM_SCOPE_BYTAG(StayCalm_Sensing);
+		trigger_registry = GetWorld()->GetSubsystem<UPanicTriggerSubsystem>();
+		room_graph = GetWorld()->GetSubsystem<UPanicRoomSubsystem>();
+		addAllPanicTriggers();
+	}
+
+	hitch_watchdog = GetWorld()->GetSubsystem<UPanicHitchWatchdog>();
 
-	//Activates the first Panic Trigger
-	UE_LOG(LogTemp, Warning, TEXT("Found All Triggers %d"), found_triggers.Num());
-	if (found_triggers.Num() >= 1)
+	event_bus = GetWorld()->GetSubsystem<UPanicEventBus>();
+	if (event_bus != nullptr)
 	{
-		UE_LOG(LogTemp, Warning, TEXT("Activated First Trigger"));
-		found_triggers[0]->set_is_visible(true);
-		found_triggers[0]->set_panic_trigger_active(true);
-		found_triggers.RemoveAt(0);
+		sight_events_handle = event_bus->on_sight_events.AddUObject(this, &AStayCalmCharacter::onPanicSightEvents);
 	}
+
+	//Activates the first Panic Trigger once every actor in the level has begun play and registered
+	UE_LOG(LogStayCalm, Log, TEXT("Found All Triggers %d"), trigger_sequence.num());
+	GetWorldTimerManager().SetTimerForNextTick(this, &AStayCalmCharacter::activateNextTrigger);
 	
 	if (BP_PauseWidgetMenu != nullptr)
 	{
+		LLM_SCOPE_BYTAG(StayCalm_UI);
 		PauseMenu = CreateWidget<UPauseMenuWidget>(UGameplayStatics::GetPlayerController(GetWorld(), 0), BP_PauseWidgetMenu);
+		UPanicHitchWatchdog::noteEvent(this, PanicHitchEvent::WidgetCreated);
 	}
 
 	
 }
 
+void AStayCalmCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (trigger_registry != nullptr)
+	{
+		trigger_registry->on_trigger_registered.Remove(trigger_registered_handle);
+	}
+
+	if (event_bus != nullptr)
+	{
+		event_bus->on_sight_events.Remove(sight_events_handle);
+	}
+
+	//Gives the player their quality settings back if play ends mid panic
+	scalability_controller.restore();
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void AStayCalmCharacter::Tick(float DeltaTime)
 {
+	updatePanicSimulation(DeltaTime);
+	post_process_controller.update(DeltaTime);
+	if (IsLocallyControlled())
+	{
+		scalability_controller.update(post_process_controller.getBlur(), DeltaTime);
+	}
+	executeDelayedMovement(DeltaTime);
+	executeDelayedLook(DeltaTime);
 	panicLineTrace();
+
+	if (hitch_watchdog != nullptr)
+	{
+		hitch_watchdog->noteCharacterState(panicLevel, movement_delay_line.num());
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -110,187 +224,144 @@ void AStayCalmCharacter::SetupPlayerInputComponent(class UInputComponent* Player
 }
 
 
-void AStayCalmCharacter::executeDelayedMovement()
+void AStayCalmCharacter::executeDelayedMovement(float DeltaTime)
 {
-	//UE_LOG(LogTemp, Warning, TEXT("Execute Delayed Movement"));
-	if (q_movement_input->Peek() != nullptr)
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_ExecuteDelayedMovement);
+	LLM_SCOPE_BYTAG(StayCalm_MovementDelay);
+
+	UWorld* world = GetWorld();
+	const float now = world->GetTimeSeconds();
+
+	//Forward and strafe input from the same frame are stored together. Frames with no input are stored too so the delayed signal stops when the input did.
+	movement_delay_line.push(now, DeltaTime, frame_movement, [](const FVector2D& run, const FVector2D& next)
 	{
-		movement *this_action = q_movement_input->Peek();
-		float value = this_action->value;
+		return run.Equals(next, movement_coalesce_tolerance);
+	});
+	frame_movement = FVector2D::ZeroVector;
 
-		if (this_action->direction == e_movement_direction::FORWARD)
-		{
-			AddMovementInput(GetActorForwardVector(), value);
-			q_movement_input->Pop();
+	//With no delay this is the input that was just recorded
+	float pushed_at = 0.0f;
+	const FVector2D* delayed_movement = movement_delay_line.sample(now, movement_time_delay, &pushed_at);
 
-			//Checks if the character is strafing
-			if (q_movement_input->Peek() != nullptr && q_movement_input->Peek()->direction == e_movement_direction::RIGHT) {
-				AddMovementInput(GetActorRightVector(), q_movement_input->Peek()->value);
-				q_movement_input->Pop();
-			}
-			//UE_LOG(LogTemp, Warning, TEXT("Moved Forward: %f"), value);
-		}
-		else if (this_action->direction == e_movement_direction::RIGHT)
-		{
-			AddMovementInput(GetActorRightVector(), this_action->value);
-			q_movement_input->Pop();
-			//UE_LOG(LogTemp, Warning, TEXT("Moved Right: %f"), value);
-			
-			//Checks if the character is strafing
-			if (q_movement_input->Peek() != nullptr && q_movement_input->Peek()->direction == e_movement_direction::FORWARD) {
-				AddMovementInput(GetActorForwardVector(), q_movement_input->Peek()->value);
-				q_movement_input->Pop();
-			}
-		}
-		/*
-		else if (this_action->direction == e_movement_direction::LOOKUP)
-		{
-			AddControllerPitchInput(value);
-			q_movement_input->Pop();
-			//UE_LOG(LogTemp, Warning, TEXT("Look Up: %d"), value);
-			
-		}
-		else if (this_action->direction == e_movement_direction::LOOKRIGHT)
-		{
-			AddControllerYawInput(value);
-			q_movement_input->Pop();
-			//UE_LOG(LogTemp, Warning, TEXT("Look Right: %d"), value);
-			
-		}
-		*/
-		GetWorldTimerManager().SetTimer(ftimer_movement_delay, this, &AStayCalmCharacter::executeDelayedMovement, movement_time_delay, true, 0);
+	//The applied input changed this frame, so time how long the change took to come through
+	if (delayed_movement != nullptr && pushed_at != applied_movement_pushed_at)
+	{
+		applied_movement_pushed_at = pushed_at;
+		movement_latency.record(panicLevel, now - pushed_at, movement_time_delay);
+		SET_FLOAT_STAT(STAT_MovementDelayActualMs, (now - pushed_at) * 1000.0f);
+		SET_FLOAT_STAT(STAT_MovementDelayErrorMs, movement_latency.lastErrorMs());
+	}
+	if (delayed_movement != nullptr && !delayed_movement->IsZero())
+	{
+		AddMovementInput((GetActorForwardVector() * delayed_movement->X) + (GetActorRightVector() * delayed_movement->Y));
 	}
-}
-
 
+	SET_DWORD_STAT(STAT_MovementDelaySegments, movement_delay_line.num());
+}
 
 
 void AStayCalmCharacter::MoveForward(float Value)
 {
+	SessionRecorder->recordAxis(PanicSessionAxis::MoveForward, Value);
 	if (Value != 0.0f)
 	{
-		if (movement_time_delay > 0) {
-			movement characterMovement;
-			characterMovement.direction = e_movement_direction::FORWARD;
-			characterMovement.value = Value / movement_speed;
-			q_movement_input->Enqueue(characterMovement);
-
-
-			if (!GetWorldTimerManager().IsTimerActive(ftimer_movement_delay))
-			{
-				AddMovementInput(GetActorForwardVector(), Value / movement_speed);
-				executeDelayedMovement();
-			}
-		}
-		else {
-			AddMovementInput(GetActorForwardVector(), Value/ movement_speed);
-		}
-		
+		frame_movement.X += Value / movement_speed;
 	}
 }
 
 void AStayCalmCharacter::MoveRight(float Value)
 {
+	SessionRecorder->recordAxis(PanicSessionAxis::MoveRight, Value);
 	if (Value != 0.0f)
 	{
-		if (movement_time_delay > 0) {
-			movement characterMovement;
-			characterMovement.direction = e_movement_direction::RIGHT;
-			characterMovement.value = Value / movement_speed;
-			q_movement_input->Enqueue(characterMovement);
-
-
-			if (!GetWorldTimerManager().IsTimerActive(ftimer_movement_delay))
-			{
-				AddMovementInput(GetActorRightVector(), Value / movement_speed);
-				executeDelayedMovement();
-			}
-		}
-		else {
-			AddMovementInput(GetActorRightVector(), Value / movement_speed);
-		}
+		frame_movement.Y += Value / movement_speed;
 	}
 }
 
 void AStayCalmCharacter::LookRight(float Value) 
 {
-	/*
-	if (Value != 0.0f) {
-		if (movement_speed > 0) {
-			movement characterMovement;
-			characterMovement.direction = e_movement_direction::LOOKRIGHT;
-			characterMovement.value = Value / movement_speed;
-			q_movement_input->Enqueue(characterMovement);
-
-
-			if (!GetWorldTimerManager().IsTimerActive(ftimer_movement_delay))
-			{
-				AddControllerYawInput(Value / movement_speed);
-				executeDelayedMovement();
-			}
-		}
-		else {
-			AddControllerYawInput(Value / movement_speed);
-		}
+	SessionRecorder->recordAxis(PanicSessionAxis::Turn, Value);
+	if (Value != 0.0f)
+	{
+		addLookInput(FVector2D(Value, 0.0f));
 	}
-	*/
-	AddControllerYawInput(Value / movement_speed);
-	
 }
 
 void AStayCalmCharacter::LookUp(float Value) 
 {
-	/*
-	if (Value != 0.0f) {
-
-		if (movement_speed > 0) {
-			movement characterMovement;
-			characterMovement.direction = e_movement_direction::LOOKUP;
-			characterMovement.value = Value / movement_speed;
-			q_movement_input->Enqueue(characterMovement);
-
-
-			if (!GetWorldTimerManager().IsTimerActive(ftimer_movement_delay))
-			{
-				AddControllerPitchInput(Value / movement_speed);
-				executeDelayedMovement();
-			}
-		}
-		else {
-			AddControllerPitchInput(Value / movement_speed);
-		}
+	SessionRecorder->recordAxis(PanicSessionAxis::LookUp, Value);
+	if (Value != 0.0f)
+	{
+		addLookInput(FVector2D(0.0f, Value));
 	}
-	*/
-	AddControllerPitchInput(Value / movement_speed);
-	
 }
 
 void AStayCalmCharacter::TurnAtRate(float Rate)
 {
+	SessionRecorder->recordAxis(PanicSessionAxis::TurnRate, Rate);
 	// calculate delta for this frame from the rate information
-	AddControllerYawInput(Rate * BaseTurnRate * GetWorld()->GetDeltaSeconds());
-	
+	if (Rate != 0.0f)
+	{
+		addLookInput(FVector2D(Rate * BaseTurnRate * GetWorld()->GetDeltaSeconds(), 0.0f));
+	}
 }
 
 void AStayCalmCharacter::LookUpAtRate(float Rate)
 {
-
+	SessionRecorder->recordAxis(PanicSessionAxis::LookUpRate, Rate);
 	// calculate delta for this frame from the rate information
-	AddControllerPitchInput(Rate * BaseLookUpRate * GetWorld()->GetDeltaSeconds());
-	
-	
+	if (Rate != 0.0f)
+	{
+		addLookInput(FVector2D(0.0f, Rate * BaseLookUpRate * GetWorld()->GetDeltaSeconds()));
+	}
+}
+
+float AStayCalmCharacter::lookSmoothTime() const
+{
+	return movement_time_delay * look_smoothing_per_delay;
+}
+
+void AStayCalmCharacter::addLookInput(const FVector2D& yaw_pitch)
+{
+	const FVector2D scaled = yaw_pitch / movement_speed;
+
+	//Without panic the look is applied straight away so it is not a frame behind
+	if (lookSmoothTime() <= 0.0f && look_filter.isSettled())
+	{
+		AddControllerYawInput(scaled.X);
+		AddControllerPitchInput(scaled.Y);
+	}
+	else
+	{
+		look_filter.addInput(scaled);
+	}
+}
+
+void AStayCalmCharacter::executeDelayedLook(float DeltaTime)
+{
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_ExecuteDelayedLook);
+
+	if (look_filter.isSettled())
+	{
+		return;
+	}
+
+	const FVector2D released = look_filter.step(DeltaTime, lookSmoothTime());
+	AddControllerYawInput(released.X);
+	AddControllerPitchInput(released.Y);
 }
 
 void AStayCalmCharacter::Pause_Game()
 {
-	UE_LOG(LogTemp, Warning, TEXT("Paused Game"));
+	LLM_SCOPE_BYTAG(StayCalm_UI);
+	UE_LOG(LogStayCalm, Verbose, TEXT("Paused Game"));
 	if (PauseMenu != nullptr)
 	{
 
-		UE_LOG(LogTemp, Warning, TEXT("Paused Game - Pause Menu Valid"));
+		UE_LOG(LogStayCalm, Verbose, TEXT("Paused Game - Pause Menu Valid"));
 		if (!PauseMenu->get_is_paused())
 		{
-			UE_LOG(LogTemp, Warning, TEXT("Paused Game - Pause Menu is not Paused. Showing Pause Screen"));
+			UE_LOG(LogStayCalm, Verbose, TEXT("Paused Game - Pause Menu is not Paused. Showing Pause Screen"));
 			PauseMenu->show();
 			// Disable the character movement but do not disable mouse movement
 			//movement_speed = 0.0f;
@@ -308,7 +379,7 @@ void AStayCalmCharacter::Pause_Game()
 		}
 		else
 		{
-			UE_LOG(LogTemp, Warning, TEXT("Paused Game - Pause Menu is Paused. Removing Pause Screen"));
+			UE_LOG(LogStayCalm, Verbose, TEXT("Paused Game - Pause Menu is Paused. Removing Pause Screen"));
 			PauseMenu->hide();
 			// Enable the character
 			//startPanic(panicLevel);
@@ -335,8 +406,13 @@ void AStayCalmCharacter::playPanicHeartBeat(float level)
 {
 	if (HeartBeatAudioCue != nullptr) 
 	{
-		HeartBeatAudioCue->SetVolumeMultiplier(level + 0.0);
-		HeartBeatAudioCue->Play();
+		//Changes the volume of a heartbeat that is already playing instead of restarting it
+		HeartBeatAudioCue->SetVolumeMultiplier(level);
+		if (!HeartBeatAudioCue->IsPlaying())
+		{
+			UPanicHitchWatchdog::noteEvent(this, PanicHitchEvent::HeartbeatStarted);
+			HeartBeatAudioCue->Play();
+		}
 		
 	}
 	
@@ -351,57 +427,90 @@ void AStayCalmCharacter::stopPlayingPanicHeartBeat()
 
 }
 
+const FPanicSymptoms& AStayCalmCharacter::symptomsForLevel(int level) const
+{
+	if (panic_profile != nullptr)
+	{
+		return panic_profile->symptomsForLevel(level);
+	}
+	return PanicProfileDefaults::symptomsForLevel(level);
+}
+
+FPanicSymptoms AStayCalmCharacter::symptomsForIntensity(float intensity) const
+{
+	const int lower_level = FMath::FloorToInt(intensity);
+	return FPanicSymptoms::blend(symptomsForLevel(lower_level), symptomsForLevel(lower_level + 1), intensity - lower_level);
+}
 
-void AStayCalmCharacter::startPanic(int level)
+int AStayCalmCharacter::maxPanicLevel() const
 {
-	//Stops any panic symptoms before starting the next level
-	stopPanic();
-	panicLevel = level;
+	if (panic_profile != nullptr)
+	{
+		return panic_profile->maxLevel();
+	}
+	return PanicProfileDefaults::num_levels - 1;
+}
+
+void AStayCalmCharacter::updatePanicSimulation(float DeltaTime)
+{
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_PanicSimulation);
+	LLM_SCOPE_BYTAG(StayCalm_PanicFX);
+
+	//Nothing to apply while the simulation is at rest
+	if (!panic_simulation.advance(DeltaTime))
+	{
+		return;
+	}
+
+	applyPanicSymptoms(symptomsForIntensity(panic_simulation.getIntensity()));
+
+	//The heartbeat speeds up with the heart rate. Small changes are not worth an audio update.
+	const float pitch = panic_simulation.getHeartRateRatio();
+	if (HeartBeatAudioCue != nullptr && FMath::Abs(pitch - heartbeat_pitch) > 0.01f)
+	{
+		HeartBeatAudioCue->SetPitchMultiplier(pitch);
+		heartbeat_pitch = pitch;
+	}
+}
+
+void AStayCalmCharacter::applyPanicSymptoms(const FPanicSymptoms& symptoms)
+{
+	if (symptoms.blur_level != current_symptoms.blur_level || symptoms.depth_level != current_symptoms.depth_level)
+	{
+		post_process_controller.setLevels(symptoms.blur_level, symptoms.depth_level);
+	}
+
+	if (symptoms.heartbeat_volume <= 0.0f)
+	{
+		if (current_symptoms.heartbeat_volume > 0.0f)
+		{
+			stopPlayingPanicHeartBeat();
+		}
+	}
+	else if (symptoms.heartbeat_volume != current_symptoms.heartbeat_volume)
+	{
+		playPanicHeartBeat(symptoms.heartbeat_volume);
+	}
 
-	switch(level) {
-
-	case 1 :
-		updatePanicBlur(1);
-		playPanicHeartBeat(.5);
-		UE_LOG(LogTemp, Warning, TEXT("Panic Level 1"));
-		break;
-	case 2 :
-		updatePanicBlur(1);
-		playPanicHeartBeat(.5);
-		updateDepthPerception(1);
-		setMovementTimeDelay(level_one_movement_time_delay);
-		movement_speed = level_one_movement_speed;
-		UE_LOG(LogTemp, Warning, TEXT("Panic Level 2"));
-		break;
-	case 3:
-		updatePanicBlur(2);
-		playPanicHeartBeat(1.5);
-		updateDepthPerception(2);
-		setMovementTimeDelay(level_two_movement_time_delay);
-		movement_speed = level_two_movement_speed;
-		UE_LOG(LogTemp, Warning, TEXT("Panic Level 3"));
-		break;
-	case 4:
-		updatePanicBlur(3);
-		playPanicHeartBeat(2.0);
-		updateDepthPerception(2);
-		setMovementTimeDelay(level_two_movement_time_delay);
-		movement_speed = level_two_movement_speed;
-		UE_LOG(LogTemp, Warning, TEXT("Panic Level 4"));
-		break;
-
-	case 5:
-		updatePanicBlur(3);
-		playPanicHeartBeat(3.0);
-		updateDepthPerception(3);
-		setMovementTimeDelay(level_three_movement_time_delay);
-		movement_speed = level_three_movement_speed;
-		UE_LOG(LogTemp, Warning, TEXT("Panic Level 5"));
-		break;
-	default:
-		stopPanic();
+	setMovementTimeDelay(symptoms.movement_time_delay);
+	movement_speed = symptoms.movement_speed;
+
+	current_symptoms = symptoms;
+}
 
+
+void AStayCalmCharacter::startPanic(int level)
+{
+	if (level != panicLevel)
+	{
+		INC_DWORD_STAT(STAT_PanicTransitions);
 	}
+	UPanicHitchWatchdog::noteEvent(this, PanicHitchEvent::PanicStarted);
+	panicLevel = level;
+
+	//Symptoms follow the simulated intensity as it approaches the new level
+	panic_simulation.setTarget(level);
+	UE_LOG(LogStayCalm, Log, TEXT("Panic Level %d"), level);
 }
 
 /*
@@ -410,138 +519,314 @@ void AStayCalmCharacter::startPanic(int level)
 void AStayCalmCharacter::stopPanic()
 {
 		
-	UE_LOG(LogTemp, Warning, TEXT("Stop Panic"));
-	updatePanicBlur(0);
-	stopPlayingPanicHeartBeat();
-	updateDepthPerception(0);
-	movement_speed = 1.0;
-	setMovementTimeDelay(0.0);
+	UE_LOG(LogStayCalm, Log, TEXT("Stop Panic"));
+	panicLevel = 0;
+	panic_simulation.reset();
+	applyPanicSymptoms(FPanicSymptoms());
+
+	if (HeartBeatAudioCue != nullptr)
+	{
+		HeartBeatAudioCue->SetPitchMultiplier(1.0f);
+	}
+	heartbeat_pitch = 1.0f;
 
 }
 
 void AStayCalmCharacter::addAllPanicTriggers()
 {
 	
-	if (GetWorld() != nullptr) 
+	if (trigger_registry != nullptr) 
 	{
 		
-		TArray<AActor*> found_actors;
-		UGameplayStatics::GetAllActorsOfClass(GetWorld(), APanicTrigger::StaticClass(), found_actors);
-		
-		for (int actor = 0; actor < found_actors.Num(); actor++)
+		for (const TWeakObjectPtr<APanicTrigger>& trigger : trigger_registry->getTriggers())
 		{
-			found_triggers.Push(Cast<APanicTrigger>(found_actors[actor]));
-			//UE_LOG(LogTemp, Warning, TEXT("Found %d triggers"), found_triggers[actor]->get_panic_level());
+			trigger_sequence.add(trigger.Get());
 		}
-		
-		found_triggers.Sort([](const APanicTrigger& a, const APanicTrigger& b) { return a.panic_level < b.panic_level; });
+
+		trigger_registered_handle = trigger_registry->on_trigger_registered.AddUObject(this, &AStayCalmCharacter::onPanicTriggerRegistered);
 		
 	}
 	
 }
 
+void AStayCalmCharacter::onPanicTriggerRegistered(APanicTrigger* trigger)
+{
+	//The registry broadcasts every registerTrigger call, so a trigger can arrive here while queued or after it was activated
+	if (!trigger_sequence.add(trigger))
+	{
+		return;
+	}
+
+	if (waiting_for_trigger)
+	{
+		activateNextTrigger();
+	}
+}
+
+void AStayCalmCharacter::activateNextTrigger()
+{
+	APanicTrigger* activated = trigger_sequence.activateNext();
+	waiting_for_trigger = activated == nullptr;
+	if (activated != nullptr)
+	{
+		SessionRecorder->recordTriggerActivated(activated->get_panic_level());
+		UPanicHitchWatchdog::noteEvent(this, PanicHitchEvent::TriggerActivated);
+		UE_LOG(LogStayCalm, Log, TEXT("Activated next trigger. Triggers left %d"), trigger_sequence.num());
+	}
+}
+
 void AStayCalmCharacter::panicLineTrace()
 {
-	UWorld *world = GetWorld();
-	
-	if (world)
+	APlayerCameraManager* camera_manager = UGameplayStatics::GetPlayerCameraManager(this, 0);
+	if (camera_manager != nullptr)
 	{
-		//Main sight
-		FHitResult hit_result;
-		FVector start = GetActorLocation();
-		FVector end = start + (UGameplayStatics::GetPlayerCameraManager(GetWorld(), 0)->GetActorForwardVector() * 500);
-		FCollisionObjectQueryParams parameters;
-		parameters.AddObjectTypesToQuery(ECollisionChannel::ECC_GameTraceChannel3);
-		parameters.AddObjectTypesToQuery(ECollisionChannel::ECC_Visibility);
+		senseFromView(camera_manager->GetCameraLocation(), camera_manager->GetCameraRotation().Quaternion());
+	}
+}
 
-		//Peripherial
+void AStayCalmCharacter::senseFromView(const FVector& eye, const FQuat& view)
+{
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_PanicLineTrace);
+	LLM_SCOPE_BYTAG(StayCalm_Sensing);
 
-		FHitResult peripherial_hit_result;
-		
-		//Left Peripherial check
-		FVector end_left = start + (UGameplayStatics::GetPlayerCameraManager(GetWorld(), 0)->GetActorForwardVector().RotateAngleAxis(35, FVector(0, 0, 1)) * 1000);
+	if (trigger_registry == nullptr)
+	{
+		return;
+	}
 
-		//Right Peripherial check
-		FVector end_right = start + (UGameplayStatics::GetPlayerCameraManager(GetWorld(), 0)->GetActorForwardVector().RotateAngleAxis(-35, FVector(0, 0, 1)) * 1000);
-		
-		FCollisionObjectQueryParams peripherial_parameters;
-		peripherial_parameters.AddObjectTypesToQuery(ECollisionChannel::ECC_GameTraceChannel2);
-		peripherial_parameters.AddObjectTypesToQuery(ECollisionChannel::ECC_WorldStatic);
+	//Nothing can start panic when no trigger is both visible and active, so skip the traces entirely
+	const FPanicTriggerGrid& trigger_grid = trigger_registry->getSensingGrid();
+	if (trigger_grid.isEmpty())
+	{
+		sight_candidates.Reset();
+		sight_rays.Reset();
+		return;
+	}
 
-		FCollisionQueryParams query_params;
-		query_params.AddIgnoredActor(this);
+	buildSightRays(trigger_grid, eye, view);
 
-		//DrawDebugLine(world, start, end, FColor::Red);
-		//DrawDebugLine(world, start, end_left, FColor::Emerald);
-		//DrawDebugLine(world, start, end_right, FColor::Emerald);
+	//for (const sight_ray& ray : sight_rays)
+	//{
+	//	DrawDebugLine(GetWorld(), ray.start, ray.end, ray.peripherial ? FColor::Emerald : FColor::Red);
+	//}
 
-		//Check Left Peripherial
-		if (world->LineTraceSingleByObjectType(peripherial_hit_result, start, end_left, peripherial_parameters, query_params) ||
-			world->LineTraceSingleByObjectType(peripherial_hit_result, start, end_right, peripherial_parameters, query_params))
+	if (CVarStayCalmAsyncSensing.GetValueOnGameThread() != 0)
+	{
+		//Results arrive at the start of next frame through onAsyncSightTrace
+		for (const sight_ray& ray : sight_rays)
+		{
+			submitAsyncSightRay(ray);
+		}
+		INC_DWORD_STAT_BY(STAT_SightRaysTraced, sight_rays.Num());
+		if (hitch_watchdog != nullptr)
 		{
+			hitch_watchdog->noteTraces(sight_rays.Num());
+		}
+		return;
+	}
 
-			APanicTrigger* trigger = Cast<APanicTrigger>(peripherial_hit_result.GetActor());
-			UE_LOG(LogTemp, Warning, TEXT("Found Peripherial Trigger"));
+	//Once a ray reaches a trigger, the remaining rays aimed at it are skipped
+	seen_candidates.Init(false, trigger_grid.num());
+	for (const sight_ray& ray : sight_rays)
+	{
+		if (seen_candidates[ray.candidate])
+		{
+			continue;
+		}
 
-			if (trigger != nullptr && trigger->get_is_visible())
-			{
+		INC_DWORD_STAT(STAT_SightRaysTraced);
+		if (hitch_watchdog != nullptr)
+		{
+			hitch_watchdog->noteTraces(1);
+		}
+		FHitResult hit_result;
+		if (traceSightRay(ray, hit_result))
+		{
+			seen_candidates[ray.candidate] = hit_result.GetActor() == trigger_grid.triggerAt(ray.candidate);
+			handleSightHit(hit_result.GetActor(), ray.peripherial);
+		}
+	}
+}
 
-				UE_LOG(LogTemp, Warning, TEXT("Peripherial Trigger is visible"));
-				if (trigger->get_panic_trigger_active())
-				{
-					UE_LOG(LogTemp, Warning, TEXT("Peripherial Trigger is active"));
-					startPanic(trigger->get_panic_level());
-					trigger->trigger_event();
-
-					//Activates the next trigger and removes it from the found triggers array.
-					if (found_triggers.Num() >= 1)
-					{
-						UE_LOG(LogTemp, Warning, TEXT("Activated next trigger. Triggers left %d"), found_triggers.Num());
-						found_triggers[0]->set_is_visible(true);
-						found_triggers[0]->set_panic_trigger_active(true);
-						found_triggers.RemoveAt(0);
-					}
-					
-				}
+//Angle of ray index out of count, spread evenly from -half_angle to half_angle
+static float fanAngle(int32 index, int32 count, float half_angle)
+{
+	return count > 1 ? FMath::Lerp(-half_angle, half_angle, (float)index / (count - 1)) : 0.0f;
+}
 
-			}
+void AStayCalmCharacter::buildSightRays(const FPanicTriggerGrid& trigger_grid, const FVector& eye, const FQuat& view)
+{
+	STAYCALM_SCOPE_CYCLE_COUNTER(STAT_BuildSightRays);
+
+	sight_rays.Reset();
+
+	//Only triggers whose bounds reach into the widest view cone get any rays
+	trigger_grid.gatherConeCandidates(eye, view.GetForwardVector(), FMath::Cos(FMath::DegreesToRadians(vision.maxHalfAngle())), vision.maxRange(), sight_candidates);
+
+	//Triggers in dormant rooms are behind walls the player cannot see through
+	if (room_graph != nullptr && room_graph->hasRooms())
+	{
+		sight_candidates.RemoveAll([this, &trigger_grid](int32 candidate) { return !room_graph->canBeSeen(trigger_grid.triggerAt(candidate)); });
+	}
+	INC_DWORD_STAT_BY(STAT_SightCandidates, sight_candidates.Num());
+	if (sight_candidates.Num() == 0)
+	{
+		return;
+	}
 
+	//Peripherial fan directions in world space
+	fan_directions.Reset();
+	for (int32 pitch_ray = 0; pitch_ray < vision.pitch_ray_count; pitch_ray++)
+	{
+		const float pitch = fanAngle(pitch_ray, vision.pitch_ray_count, vision.peripherial_pitch_half_angle);
+		for (int32 yaw_ray = 0; yaw_ray < vision.yaw_ray_count; yaw_ray++)
+		{
+			const float yaw = fanAngle(yaw_ray, vision.yaw_ray_count, vision.peripherial_yaw_half_angle);
+			fan_directions.Add(view.RotateVector(FRotator(pitch, yaw, 0.0f).Vector()));
 		}
-		
-		if (world->LineTraceSingleByObjectType(hit_result, start, end, parameters, query_params))
+	}
+
+	for (int32 candidate : sight_candidates)
+	{
+		const FVector to_center = trigger_grid.centerAt(candidate) - eye;
+		const FVector direction = to_center.GetSafeNormal();
+
+		//Distance to the nearest point of the trigger's bounds
+		const float distance = to_center.Size() - trigger_grid.radiusAt(candidate);
+		bool peripherial = false;
+		const float range = vision.rangeFor(view.UnrotateVector(direction), distance, peripherial);
+		if (range <= 0.0f || distance > range)
 		{
-			
-			APanicTrigger* trigger = Cast<APanicTrigger>(hit_result.GetActor());
-			UE_LOG(LogTemp, Warning, TEXT("Found Trigger"));
+			continue;
+		}
 
-			if (trigger != nullptr && trigger->get_is_visible())
+		int32 rays_added = 0;
+		if (peripherial)
+		{
+			const FBox& bounds = trigger_grid.boundsAt(candidate);
+			for (const FVector& fan_direction : fan_directions)
 			{
-				 
-				UE_LOG(LogTemp, Warning, TEXT("Trigger is visible"));
-				if (trigger->get_panic_trigger_active())
+				if (rays_added >= vision.max_rays_per_trigger)
 				{
-					UE_LOG(LogTemp, Warning, TEXT("Trigger is active"));
-					startPanic(trigger->get_panic_level());
-					trigger->trigger_event();
-
-					if (found_triggers.Num() >= 1)
-					{
-						//Activates the next trigger and removes it from the found triggers array.
-						UE_LOG(LogTemp, Warning, TEXT("Activated next trigger. Triggers left %d"), found_triggers.Num());
-						found_triggers[0]->set_is_visible(true);
-						found_triggers[0]->set_panic_trigger_active(true);
-						found_triggers.RemoveAt(0);
-					}
-					
-					
-					
-					
+					break;
+				}
+
+				const FVector end = eye + (fan_direction * range);
+				if (FMath::LineBoxIntersection(bounds, eye, end, end - eye))
+				{
+					sight_rays.Add({ eye, end, true, candidate });
+					rays_added++;
 				}
-				
 			}
-			
 		}
-		
-		
+
+		//Main sight, or a trigger small enough to sit between the fan rays, gets one ray aimed at its center
+		if (rays_added == 0)
+		{
+			sight_rays.Add({ eye, eye + (direction * range), peripherial, candidate });
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_SightRaysBuilt, sight_rays.Num());
+}
+
+FCollisionObjectQueryParams AStayCalmCharacter::sightObjectParams(bool peripherial)
+{
+	FCollisionObjectQueryParams parameters;
+	if (peripherial)
+	{
+		parameters.AddObjectTypesToQuery(ECollisionChannel::ECC_GameTraceChannel2);
+		parameters.AddObjectTypesToQuery(ECollisionChannel::ECC_WorldStatic);
+	}
+	else
+	{
+		parameters.AddObjectTypesToQuery(ECollisionChannel::ECC_GameTraceChannel3);
+		parameters.AddObjectTypesToQuery(ECollisionChannel::ECC_Visibility);
+	}
+	return parameters;
+}
+
+bool AStayCalmCharacter::traceSightRay(const sight_ray& ray, FHitResult& out_hit)
+{
+	FCollisionQueryParams query_params;
+	query_params.AddIgnoredActor(this);
+
+	return GetWorld()->LineTraceSingleByObjectType(out_hit, ray.start, ray.end, sightObjectParams(ray.peripherial), query_params);
+}
+
+void AStayCalmCharacter::submitAsyncSightRay(const sight_ray& ray)
+{
+	FCollisionQueryParams query_params;
+	query_params.AddIgnoredActor(this);
+
+	GetWorld()->AsyncLineTraceByObjectType(EAsyncTraceType::Single, ray.start, ray.end, sightObjectParams(ray.peripherial), query_params, &async_sight_delegate, ray.peripherial ? 1 : 0);
+}
+
+void AStayCalmCharacter::onAsyncSightTrace(const FTraceHandle& handle, FTraceDatum& datum)
+{
+	LLM_SCOPE_BYTAG(StayCalm_Sensing);
+
+	for (const FHitResult& hit : datum.OutHits)
+	{
+		if (hit.bBlockingHit)
+		{
+			handleSightHit(hit.GetActor(), datum.UserData != 0);
+			break;
+		}
+	}
+}
+
+void AStayCalmCharacter::handleSightHit(AActor* hit_actor, bool peripherial)
+{
+	INC_DWORD_STAT(STAT_SightHits);
+	APanicTrigger* trigger = Cast<APanicTrigger>(hit_actor);
+	UE_LOG(LogStayCalm, VeryVerbose, TEXT("Found %s Trigger"), peripherial ? TEXT("Peripherial") : TEXT("Main Sight"));
+
+	if (trigger != nullptr && trigger->get_is_visible())
+	{
+		UE_LOG(LogStayCalm, VeryVerbose, TEXT("Trigger is visible"));
+		trigger_registry->reportSighted(trigger);
+
+		//Panic is started once per frame from onPanicSightEvents, after every ray has been traced
+		if (event_bus != nullptr)
+		{
+			event_bus->postSight(trigger, peripherial);
+		}
+	}
+}
+
+void AStayCalmCharacter::onPanicSightEvents(const TArray<FPanicSightEvent>& events)
+{
+	LLM_SCOPE_BYTAG(StayCalm_PanicFX);
+
+	//Events arrive highest priority first, so the active ones come first and the first of them sets the panic level.
+	//Every active trigger seen this frame still fires, otherwise a second trigger sighted on the same frame stays active.
+	bool panic_started = false;
+	for (const FPanicSightEvent& event : events)
+	{
+		if (!event.active)
+		{
+			break;
+		}
+
+		if (event.trigger == nullptr || !event.trigger->get_panic_trigger_active())
+		{
+			continue;
+		}
+
+		UE_LOG(LogStayCalm, Verbose, TEXT("Trigger is active"));
+		if (!panic_started)
+		{
+			startPanic(event.panic_level);
+			panic_started = true;
+		}
+
+		{
+			STAYCALM_SCOPE_CYCLE_COUNTER(STAT_PanicBlueprintEvents);
+			INC_DWORD_STAT(STAT_PanicBlueprintEventCalls);
+			event.trigger->trigger_event();
+		}
+
+		activateNextTrigger();
 	}
-}
\ No newline at end of file
+}
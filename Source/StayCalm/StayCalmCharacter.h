@@ -2,10 +2,22 @@
 
 #pragma once
 
+#include "DelayLine.h"
+#include "PanicEventBus.h"
+#include "PanicLatencyHistogram.h"
+#include "PanicLookFilter.h"
+#include "PanicPostProcess.h"
+#include "PanicScalability.h"
+#include "PanicSimulation.h"
+#include "PanicSymptoms.h"
 #include "PanicTrigger.h"
+#include "PanicTriggerGrid.h"
+#include "PanicTriggerSequencer.h"
+#include "PanicVision.h"
 #include "PauseMenuWidget.h"
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
+#include "WorldCollision.h"
 #include "StayCalmCharacter.generated.h"
 
 
@@ -16,6 +28,9 @@ class AStayCalmCharacter : public ACharacter
 {
 	GENERATED_BODY()
 
+	//Drives the character headless with scripted input and times its per-frame work
+	friend class UStayCalmSimulationCommandlet;
+
 	/** First person camera */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class UCameraComponent* FirstPersonCameraComponent;
@@ -23,78 +38,221 @@ class AStayCalmCharacter : public ACharacter
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Panic, meta = (AllowPrivateAccess = "true"))
 	class UPostProcessComponent* PanicPostProcess;
+
+	//Records the play session for offline replay. Idle unless started.
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Panic, meta = (AllowPrivateAccess = "true"))
+	class UPanicSessionRecorder* SessionRecorder;
 public:
 	AStayCalmCharacter();
 
 protected:
 	virtual void BeginPlay();
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	void Tick(float DeltaTime);
 
 
 	// --------------- Panic Variables ----------------------------
+	//Panic level of the last trigger seen. The simulated intensity approaches it.
 	int panicLevel = 0;
 
-	//Constant level variables for the different stages of movement time delay for movement_time_delay
-	const float level_one_movement_time_delay = .5f;
-	const float level_two_movement_time_delay = .75f;
-	const float level_three_movement_time_delay = 1.0f;
-	//The delay that the character experiences during panic. Default = 0.0, Level 1 = .5 , Level 2 = .75, Level 3 = 1
+	//How quickly panic rises and falls, and how the heart rate follows it
+	UPROPERTY(EditAnywhere, Category = Panic)
+		FPanicSimulationSettings panic_simulation_settings;
+
+	//Continuous panic intensity. Symptoms are sampled from it every frame it changes.
+	FPanicSimulation panic_simulation;
+
+	//Steps the panic simulation and applies the symptoms for the new intensity. Called every frame.
+	void updatePanicSimulation(float DeltaTime);
+
+	//Heartbeat pitch last sent to HeartBeatAudioCue
+	float heartbeat_pitch = 1.0f;
+
+	//Panic levels to use. When not set the built-in levels in PanicProfileDefaults are used.
+	UPROPERTY(EditDefaultsOnly, Category = Panic)
+		class UPanicProfile* panic_profile;
+
+	//The delay that the character experiences during panic. Set from the panic level's symptoms, 0 when calm.
 	UPROPERTY ()
 		float movement_time_delay = 0.0f;
 
 
-	//Constant level variables for the different stages of movement slowed speed for movement_speed
-	const float level_one_movement_speed = 1.5f;
-	const float level_two_movement_speed = 2.0f;
-	const float level_three_movement_speed = 3.0f;
-	//This is the denominator for the movement speed 1. When set to 1 the movement is 1/1 and when set to 2 the speed is 1/2 etc. Default = 1.0, Level 1 = 1.5 , Level 2 = 2.0, Level 3 = 3
+	//This is the denominator for the movement speed 1. When set to 1 the movement is 1/1 and when set to 2 the speed is 1/2 etc. Set from the panic level's symptoms, 1 when calm.
 	UPROPERTY()
 		float movement_speed = 1.0f;
 
 	void setMovementTimeDelay(float time_delay);
 
-	//Timer handle for Delayed movement
-	FTimerHandle ftimer_movement_delay;
+	//Movement input gathered from MoveForward (X) and MoveRight (Y) this frame, already scaled by movement_speed
+	FVector2D frame_movement = FVector2D::ZeroVector;
 
-	enum e_movement_direction {
-		FORWARD,
-		RIGHT,
-		LOOKUP,
-		LOOKRIGHT,
-	};
+	//Most movement segments held while delayed. Steady input coalesces into a single segment, so this is only reached by noisy analog input.
+	static constexpr int32 movement_delay_capacity = 256;
 
+	//Largest per-axis difference between two frames of movement input that are still stored as one segment
+	static constexpr float movement_coalesce_tolerance = 0.01f;
 
-	struct movement
-	{
-		int direction;
-		float value;
-	};
+	//Movement input waiting out movement_time_delay, stored as runs of similar 2D input
+	TDelayLine<FVector2D> movement_delay_line { movement_delay_capacity };
+
+	//Records this frame's movement input and applies the input from movement_time_delay ago. Called every frame.
+	void executeDelayedMovement(float DeltaTime);
+
+	//Delay between movement input changing and the change being applied, against movement_time_delay
+	FPanicLatencyHistogram movement_latency;
+
+	//When the run of movement input being applied was pushed. A new value means the applied input just changed.
+	float applied_movement_pushed_at = -1.0f;
+
+	//Seconds of look smoothing per second of movement_time_delay. At the highest panic level look lags by about this long.
+	UPROPERTY(EditAnywhere, Category = Panic, meta = (ClampMin = "0.0"))
+		float look_smoothing_per_delay = 0.3f;
 
-	void executeDelayedMovement();
+	//Delays and damps mouse and gamepad look input during panic
+	FPanicLookFilter look_filter;
+
+	//How long look input takes to come through at the current panic level
+	float lookSmoothTime() const;
+
+	//Scales look input by movement_speed and either applies it now or hands it to look_filter
+	void addLookInput(const FVector2D& yaw_pitch);
+
+	//Applies the look input released by look_filter this frame. Called every frame.
+	void executeDelayedLook(float DeltaTime);
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Panic)
 		class UAudioComponent* HeartBeatAudioCue;		
 
 	void playPanicHeartBeat(float level);
 	void stopPlayingPanicHeartBeat();
+	//Sets the panic level the simulated intensity rises or falls towards
 	void startPanic(int level);
+
+	//Returns to calm straight away
 	void stopPanic();
 
-	TQueue<movement> *q_movement_input = new TQueue<movement>;
+	//Symptoms currently applied to the character
+	FPanicSymptoms current_symptoms;
+
+	//Returns the symptoms for a panic level from panic_profile, or the built-in levels. Levels past the highest use the highest.
+	const FPanicSymptoms& symptomsForLevel(int level) const;
+
+	//Blends the symptoms of the two panic levels either side of a continuous intensity
+	FPanicSymptoms symptomsForIntensity(float intensity) const;
+
+	//Highest panic level in panic_profile, or in the built-in levels
+	int maxPanicLevel() const;
+
+	//Moves the character to the given symptoms. Only fields that differ from current_symptoms are applied.
+	void applyPanicSymptoms(const FPanicSymptoms& symptoms);
+
+	//Triggers that have not been activated yet, in order of panic level
+	FPanicTriggerSequencer trigger_sequence;
+
+	//Shows and activates the next trigger in the sequence. The only place triggers are activated from.
+	void activateNextTrigger();
+
+	//True when the sequence ran out of triggers. The next trigger to register, e.g. from a streamed level, is activated straight away.
+	bool waiting_for_trigger = false;
+
+	//The world's trigger registry. Owns the sensing grid of live triggers.
+	UPROPERTY()
+		class UPanicTriggerSubsystem* trigger_registry;
+
+	//Room graph of interior levels. Triggers in rooms the player cannot see into are not traced.
+	UPROPERTY()
+		class UPanicRoomSubsystem* room_graph;
 
-	TArray<APanicTrigger*> found_triggers;
+	FDelegateHandle trigger_registered_handle;
 
+	void onPanicTriggerRegistered(APanicTrigger* trigger);
+
+	//Queues every registered trigger and listens for triggers that register later
 	void addAllPanicTriggers();
 
+	//Senses triggers from the player camera
 	void panicLineTrace();
 
-	//Updates intesity of the blur a user will experience. Level 0 - No Blur, Level 3 Max Blur
-	UFUNCTION(BlueprintImplementableEvent, Category=Panic)
+	//A single sight ray cast from the character's eyes
+	struct sight_ray
+	{
+		FVector start;
+		FVector end;
+		//Peripherial rays look for PeripherialTriggerObject, main sight looks for PanicTriggerObject
+		bool peripherial;
+		//Index in the sensing grid of the trigger the ray is aimed at
+		int32 candidate;
+	};
+
+	//What the character can see when looking for triggers
+	UPROPERTY(EditAnywhere, Category = Panic)
+		FPanicVisionSettings vision;
+
+	//Fills sight_rays with the rays worth tracing this frame. Rays are only spent on triggers inside the view cone.
+	void buildSightRays(const FPanicTriggerGrid& trigger_grid, const FVector& eye, const FQuat& view);
+
+	//Scratch arrays reused every frame by buildSightRays
+	TArray<sight_ray> sight_rays;
+	TArray<int32> sight_candidates;
+	TArray<FVector> fan_directions;
+
+	//Grid entries a ray has already reached this frame, reused by senseFromView
+	TBitArray<> seen_candidates;
+
+	static FCollisionObjectQueryParams sightObjectParams(bool peripherial);
+
+	//Traces the ray on the game thread
+	bool traceSightRay(const sight_ray& ray, FHitResult& out_hit);
+
+	//Queues the ray with the async trace batch for this frame. The result is handled by onAsyncSightTrace next frame.
+	void submitAsyncSightRay(const sight_ray& ray);
+
+	void onAsyncSightTrace(const FTraceHandle& handle, FTraceDatum& datum);
+
+	FTraceDelegate async_sight_delegate;
+
+	//Posts the sighting to the event bus if the actor hit by a sight ray is a visible trigger
+	void handleSightHit(AActor* hit_actor, bool peripherial);
+
+	//Collects this frame's sightings so each trigger is handled once, however many rays reached it
+	UPROPERTY()
+		class UPanicEventBus* event_bus;
+
+	FDelegateHandle sight_events_handle;
+
+	//Told the character's state every frame so hitches can be matched to gameplay
+	UPROPERTY()
+		class UPanicHitchWatchdog* hitch_watchdog;
+
+	//Starts panic and activates the next trigger for the highest priority active sighting of the frame
+	void onPanicSightEvents(const TArray<FPanicSightEvent>& events);
+
+	//How panic blur and depth perception look on PanicPostProcess and the camera
+	UPROPERTY(EditAnywhere, Category = Panic)
+		FPanicPostProcessSettings post_process_settings;
+
+	//Optional. Receives PanicBlur and PanicDepth, 0 to 1, for materials that react to panic.
+	UPROPERTY(EditDefaultsOnly, Category = Panic)
+		class UMaterialParameterCollection* panic_parameter_collection;
+
+	//Blends the panic post process towards the current blur and depth levels
+	FPanicPostProcessController post_process_controller;
+
+	//How far rendering quality drops while panic blur hides the detail
+	UPROPERTY(EditAnywhere, Category = Panic)
+		FPanicScalabilitySettings scalability_settings;
+
+	//Lowers resolution, shadow and post process quality with the panic blur for the locally controlled character
+	FPanicScalabilityController scalability_controller;
+
+	//No longer called. The blur is applied natively by post_process_controller, so a Blueprint applying it as well would double it.
+	UFUNCTION(BlueprintImplementableEvent, Category=Panic, meta = (DeprecatedFunction, DeprecationMessage = "Panic blur is applied natively. Read PanicBlur from the panic parameter collection instead."))
 		void updatePanicBlur(int level);
 
-	//Updates intesity of the depth perception change user will experience. Level 0 - No change, Level 3 Max distance the camera will view.
-	UFUNCTION(BlueprintImplementableEvent, Category = Panic)
+	//No longer called. Depth perception is applied natively by post_process_controller, so a Blueprint applying it as well would double it.
+	UFUNCTION(BlueprintImplementableEvent, Category = Panic, meta = (DeprecatedFunction, DeprecationMessage = "Depth perception is applied natively. Read PanicDepth from the panic parameter collection instead."))
 		void updateDepthPerception(int level);
 
 	//------------------------ UI / HUD ---------------------------
@@ -113,6 +271,20 @@ protected:
 						
 
 public:
+	//Looks for triggers from the given eye position and view. Called by panicLineTrace every frame, and by tools that drive sensing without a player camera.
+	void senseFromView(const FVector& eye, const FQuat& view);
+
+	//The last panic level started
+	inline int getPanicLevel() const { return panicLevel; }
+
+	inline const FPanicLatencyHistogram& getMovementLatency() const { return movement_latency; }
+
+	inline void resetMovementLatency() { movement_latency.reset(); }
+
+	//Number of candidate triggers and sight rays built by the last sensing pass
+	inline int32 getSightCandidateCount() const { return sight_candidates.Num(); }
+	inline int32 getSightRayCount() const { return sight_rays.Num(); }
+
 	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
 	float BaseTurnRate;
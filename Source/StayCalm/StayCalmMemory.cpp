@@ -0,0 +1,101 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "StayCalmMemory.h"
+#include "StayCalm.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+
+//Unique name of a tag declared with LLM_DEFINE_TAG
+#define STAYCALM_LLM_TAG_NAME(Tag) PREPROCESSOR_JOIN(LLMTagDeclaration_, Tag).GetUniqueName()
+
+void FStayCalmMemoryTracker::start()
+{
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	if (!FLowLevelMemTracker::IsEnabled())
+	{
+		return;
+	}
+
+	tags.Reset();
+	for (const FName tag : {
+		STAYCALM_LLM_TAG_NAME(StayCalm),
+		STAYCALM_LLM_TAG_NAME(StayCalm_Sensing),
+		STAYCALM_LLM_TAG_NAME(StayCalm_MovementDelay),
+		STAYCALM_LLM_TAG_NAME(StayCalm_PanicFX),
+		STAYCALM_LLM_TAG_NAME(StayCalm_UI),
+		STAYCALM_LLM_TAG_NAME(StayCalm_Projectiles) })
+	{
+		tags.Add({ tag });
+	}
+
+	end_frame_handle = FCoreDelegates::OnEndFrame.AddRaw(this, &FStayCalmMemoryTracker::sample);
+
+	dump_command = IConsoleManager::Get().RegisterConsoleCommand(
+		TEXT("StayCalm.Memory.DumpHighWater"),
+		TEXT("Prints the current and highest amount of memory tracked under each StayCalm LLM tag."),
+		FConsoleCommandWithOutputDeviceDelegate::CreateRaw(this, &FStayCalmMemoryTracker::dumpHighWater),
+		ECVF_Default);
+
+	reset_command = IConsoleManager::Get().RegisterConsoleCommand(
+		TEXT("StayCalm.Memory.ResetHighWater"),
+		TEXT("Sets the high-water mark of each StayCalm LLM tag to its current amount."),
+		FConsoleCommandDelegate::CreateRaw(this, &FStayCalmMemoryTracker::resetHighWater),
+		ECVF_Default);
+#endif
+}
+
+void FStayCalmMemoryTracker::stop()
+{
+	FCoreDelegates::OnEndFrame.Remove(end_frame_handle);
+	end_frame_handle.Reset();
+
+	if (dump_command != nullptr)
+	{
+		IConsoleManager::Get().UnregisterConsoleObject(dump_command);
+		dump_command = nullptr;
+	}
+
+	if (reset_command != nullptr)
+	{
+		IConsoleManager::Get().UnregisterConsoleObject(reset_command);
+		reset_command = nullptr;
+	}
+
+	tags.Reset();
+}
+
+void FStayCalmMemoryTracker::sample()
+{
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	FLowLevelMemTracker& tracker = FLowLevelMemTracker::Get();
+	for (tag_usage& usage : tags)
+	{
+		usage.current = tracker.GetTagAmountForTracker(ELLMTracker::Default, usage.tag);
+		usage.high_water = FMath::Max(usage.high_water, usage.current);
+	}
+#endif
+}
+
+void FStayCalmMemoryTracker::dumpHighWater(FOutputDevice& output) const
+{
+	if (tags.Num() == 0)
+	{
+		output.Logf(TEXT("StayCalm memory is only tracked when running with -llm"));
+		return;
+	}
+
+	output.Logf(TEXT("%-32s %12s %12s"), TEXT("Tag"), TEXT("Current KB"), TEXT("Peak KB"));
+	for (const tag_usage& usage : tags)
+	{
+		output.Logf(TEXT("%-32s %12.1f %12.1f"), *usage.tag.ToString(), usage.current / 1024.0, usage.high_water / 1024.0);
+	}
+}
+
+void FStayCalmMemoryTracker::resetHighWater()
+{
+	for (tag_usage& usage : tags)
+	{
+		usage.high_water = usage.current;
+	}
+}
@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Keeps the high-water mark of each StayCalm LLM tag. Samples once per frame, and only when the game runs with -llm.
+ * "StayCalm.Memory.DumpHighWater" prints the current and highest amount of every tag.
+ */
+class FStayCalmMemoryTracker
+{
+public:
+	void start();
+
+	void stop();
+
+	//Prints every tag's current amount and high-water mark
+	void dumpHighWater(FOutputDevice& output) const;
+
+	//Forgets the high-water marks so a new measurement can start from the current amounts
+	void resetHighWater();
+
+private:
+	struct tag_usage
+	{
+		FName tag;
+		int64 current = 0;
+		int64 high_water = 0;
+	};
+
+	//Reads the current amount of every tag. Bound to the end of every frame.
+	void sample();
+
+	TArray<tag_usage> tags;
+
+	FDelegateHandle end_frame_handle;
+
+	IConsoleObject* dump_command = nullptr;
+
+	IConsoleObject* reset_command = nullptr;
+};
@@ -3,9 +3,12 @@
 #include "StayCalmProjectile.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
+#include "StayCalm.h"
 
 AStayCalmProjectile::AStayCalmProjectile() 
 {
+	LLM_SCOPE_BYTAG(StayCalm_Projectiles);
+
 	// Use a sphere as a simple collision representation
 	CollisionComp = CreateDefaultSubobject<USphereComponent>(TEXT("SphereComp"));
 	CollisionComp->InitSphereRadius(5.0f);